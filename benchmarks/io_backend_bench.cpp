@@ -0,0 +1,145 @@
+// AsyncIO backend comparison: epoll vs io_uring.
+//
+// Runs a TCP echo ping-pong over loopback with every socket, client and
+// server side, on one reactor. Reports round trips per second and the
+// reactor syscalls (waits plus registration changes) per round trip; the
+// send/recv calls are the same for both backends and not counted.
+//
+//   io_backend_bench [connections] [seconds] [message bytes]
+//                    (default: 64 2 64)
+
+#include "async_io.h"
+#include "socket.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace netprobe;
+
+namespace {
+
+struct Options {
+    size_t connections = 64;
+    int seconds = 2;
+    size_t message = 64;
+};
+
+// Loopback pairs: clients[i] is connected to servers[i]
+bool connect_pairs(size_t count, std::vector<Socket>& clients, std::vector<Socket>& servers) {
+    Socket listener(Socket::Type::TCP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    
+    if (::bind(listener.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::getsockname(listener.fd(), reinterpret_cast<sockaddr*>(&addr), &len) < 0 ||
+        !listener.listen(static_cast<int>(count))) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < count; ++i) {
+        Socket client(Socket::Type::TCP);
+        if (::connect(client.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            return false;
+        }
+        auto server = listener.accept();
+        if (!server) return false;
+        
+        for (Socket* sock : {&client, &*server}) {
+            sock->set_nonblocking(true);
+            sock->set_nodelay(true);
+        }
+        clients.push_back(std::move(client));
+        servers.push_back(std::move(*server));
+    }
+    return true;
+}
+
+void run(AsyncIO::Backend requested, const Options& options) {
+    AsyncIO io(requested);
+    if (io.backend() != requested) {
+        std::printf("%-9s unavailable on this kernel\n", AsyncIO::backend_name(requested));
+        return;
+    }
+    
+    std::vector<Socket> clients;
+    std::vector<Socket> servers;
+    if (!connect_pairs(options.connections, clients, servers)) {
+        std::fprintf(stderr, "failed to set up loopback connections\n");
+        return;
+    }
+    
+    std::vector<char> message(options.message, 'x');
+    std::vector<char> buffer(64 * 1024);
+    uint64_t round_trips = 0;
+    uint64_t errors = 0;
+    
+    // Server side echoes whatever arrives
+    for (auto& server : servers) {
+        io.add(server.fd(), AsyncIO::Event::READ, [&](int fd, AsyncIO::Event) {
+            ssize_t n = ::recv(fd, buffer.data(), buffer.size(), 0);
+            if (n <= 0 || ::send(fd, buffer.data(), n, MSG_NOSIGNAL) != n) ++errors;
+        });
+    }
+    
+    // Client side sends the next message once the echo is complete
+    std::vector<size_t> received(clients.size());
+    for (size_t i = 0; i < clients.size(); ++i) {
+        io.add(clients[i].fd(), AsyncIO::Event::READ, [&, i](int fd, AsyncIO::Event) {
+            ssize_t n = ::recv(fd, buffer.data(), buffer.size(), 0);
+            if (n <= 0) {
+                ++errors;
+                return;
+            }
+            received[i] += n;
+            if (received[i] < message.size()) return;
+            
+            received[i] = 0;
+            ++round_trips;
+            if (::send(fd, message.data(), message.size(), MSG_NOSIGNAL) < 0) ++errors;
+        });
+    }
+    
+    uint64_t syscalls_before = io.syscalls();
+    auto start = steady_clock::now();
+    auto deadline = start + std::chrono::seconds(options.seconds);
+    
+    for (auto& client : clients) {
+        ::send(client.fd(), message.data(), message.size(), MSG_NOSIGNAL);
+    }
+    io.schedule_at(deadline, [&] { io.stop(); });
+    io.run();
+    
+    double elapsed = std::chrono::duration<double>(steady_clock::now() - start).count();
+    double syscalls = static_cast<double>(io.syscalls() - syscalls_before);
+    
+    std::printf("%-9s %10.0f round trips/s  %8.2f MB/s  %6.3f reactor syscalls/round trip%s\n",
+                AsyncIO::backend_name(io.backend()),
+                round_trips / elapsed,
+                2.0 * round_trips * options.message / elapsed / 1e6,
+                round_trips ? syscalls / round_trips : 0.0,
+                errors ? "  (errors)" : "");
+    
+    for (auto& sock : clients) io.remove(sock.fd());
+    for (auto& sock : servers) io.remove(sock.fd());
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (argc > 1) options.connections = std::strtoul(argv[1], nullptr, 10);
+    if (argc > 2) options.seconds = std::atoi(argv[2]);
+    if (argc > 3) options.message = std::strtoul(argv[3], nullptr, 10);
+    
+    std::printf("%zu loopback connections, %zu byte messages, %ds per backend\n",
+                options.connections, options.message, options.seconds);
+    
+    run(AsyncIO::Backend::EPOLL, options);
+    run(AsyncIO::Backend::IO_URING, options);
+    return 0;
+}
@@ -45,7 +45,14 @@ void Table::add_row(std::vector<std::string> row) {
 }
 
 std::string Table::render() const {
-    if (headers_.empty()) return "";
+    std::string result;
+    render_to(result);
+    return result;
+}
+
+void Table::render_to(std::string& out) const {
+    out.clear();
+    if (headers_.empty()) return;
     
     // Calculate column widths
     std::vector<size_t> widths(headers_.size());
@@ -58,57 +65,52 @@ std::string Table::render() const {
         }
     }
     
-    std::string result;
+    // Cells are appended piece by piece, without temporaries, so a buffer
+    // that held the last frame needs no new memory for this one
+    auto border = [&](const char* left, const char* middle, const char* right) {
+        out += left;
+        for (size_t i = 0; i < widths.size(); ++i) {
+            out.append(widths[i] + 2, *box::HORIZONTAL);
+            if (i < widths.size() - 1) out += middle;
+        }
+        out += right;
+        out += "\n";
+    };
+    auto cell = [&](std::string_view text, size_t width, const char* color) {
+        out += ' ';
+        if (color && colors_enabled) {
+            out += color;
+            out += text;
+            out += color::RESET;
+        } else {
+            out += text;
+        }
+        out.append(width - text.length(), ' ');
+        out += ' ';
+        out += box::VERTICAL;
+    };
     
-    // Top border
-    result += box::TOP_LEFT;
-    for (size_t i = 0; i < widths.size(); ++i) {
-        result += std::string(widths[i] + 2, *box::HORIZONTAL);
-        if (i < widths.size() - 1) result += box::T_DOWN;
-    }
-    result += box::TOP_RIGHT;
-    result += "\n";
+    border(box::TOP_LEFT, box::T_DOWN, box::TOP_RIGHT);
     
     // Header
-    result += box::VERTICAL;
+    out += box::VERTICAL;
     for (size_t i = 0; i < headers_.size(); ++i) {
-        result += " " + colorize(headers_[i], color::BOLD);
-        result += std::string(widths[i] - headers_[i].length(), ' ') + " ";
-        result += box::VERTICAL;
+        cell(headers_[i], widths[i], color::BOLD);
     }
-    result += "\n";
+    out += "\n";
     
-    // Header separator
-    result += box::T_RIGHT;
-    for (size_t i = 0; i < widths.size(); ++i) {
-        result += std::string(widths[i] + 2, *box::HORIZONTAL);
-        if (i < widths.size() - 1) result += box::CROSS;
-    }
-    result += box::T_LEFT;
-    result += "\n";
+    border(box::T_RIGHT, box::CROSS, box::T_LEFT);
     
     // Rows
     for (const auto& row : rows_) {
-        result += box::VERTICAL;
+        out += box::VERTICAL;
         for (size_t i = 0; i < headers_.size(); ++i) {
-            std::string cell = i < row.size() ? row[i] : "";
-            result += " " + cell;
-            result += std::string(widths[i] - cell.length(), ' ') + " ";
-            result += box::VERTICAL;
+            cell(i < row.size() ? std::string_view(row[i]) : std::string_view(), widths[i], nullptr);
         }
-        result += "\n";
+        out += "\n";
     }
     
-    // Bottom border
-    result += box::BOTTOM_LEFT;
-    for (size_t i = 0; i < widths.size(); ++i) {
-        result += std::string(widths[i] + 2, *box::HORIZONTAL);
-        if (i < widths.size() - 1) result += box::T_UP;
-    }
-    result += box::BOTTOM_RIGHT;
-    result += "\n";
-    
-    return result;
+    border(box::BOTTOM_LEFT, box::T_UP, box::BOTTOM_RIGHT);
 }
 
 // Progress bar implementation
@@ -116,6 +118,10 @@ ProgressBar::ProgressBar(size_t total, size_t width)
     : total_(total), width_(width), last_printed_(0) {}
 
 void ProgressBar::update(size_t current) {
+    update(current, {});
+}
+
+void ProgressBar::update(size_t current, std::string_view status) {
     if (!is_tty()) return;
     
     double percentage = total_ > 0 ? (double)current / total_ : 0.0;
@@ -130,6 +136,10 @@ void ProgressBar::update(size_t current) {
         }
     }
     std::printf("] %3.0f%% (%zu/%zu)", percentage * 100, current, total_);
+    if (!status.empty()) {
+        // Clear to the end of line; the status may be shorter than the last one
+        std::printf("  %.*s\033[K", static_cast<int>(status.size()), status.data());
+    }
     std::fflush(stdout);
     
     last_printed_ = current;
@@ -140,6 +150,12 @@ void ProgressBar::finish() {
     std::printf("\n");
 }
 
+void ProgressBar::clear() {
+    if (!is_tty()) return;
+    std::printf("\r\033[K");
+    std::fflush(stdout);
+}
+
 // Histogram rendering
 std::string render_histogram(const std::vector<double>& values, size_t bins, size_t width) {
     if (values.empty()) return "";
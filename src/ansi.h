@@ -72,6 +72,13 @@ public:
     Table(std::vector<std::string> headers);
     void add_row(std::vector<std::string> row);
     std::string render() const;
+    
+    // For tables redrawn in place: cells are rewritten where they stand,
+    // and the table rendered over the last frame's buffer, so a refresh
+    // reuses the memory of the one before
+    size_t size() const { return rows_.size(); }
+    std::vector<std::string>& row(size_t index) { return rows_[index]; }
+    void render_to(std::string& out) const;
 
 private:
     std::vector<std::string> headers_;
@@ -83,7 +90,13 @@ class ProgressBar {
 public:
     ProgressBar(size_t total, size_t width = 50);
     void update(size_t current);
+    
+    // As update(), followed by a short status such as a live rate
+    void update(size_t current, std::string_view status);
     void finish();
+    
+    // Erase the bar so a line can be printed; the next update() redraws it
+    void clear();
 
 private:
     size_t total_;
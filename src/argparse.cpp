@@ -8,9 +8,10 @@ namespace netprobe {
 ArgParser::ArgParser(std::string_view description) 
     : description_(description) {}
 
-void ArgParser::add_positional(std::string name, std::string help) {
+void ArgParser::add_positional(std::string name, std::string help, bool required) {
     positional_names_.push_back(std::move(name));
     positional_help_.push_back(std::move(help));
+    positional_required_.push_back(required);
 }
 
 void ArgParser::add_option(std::string name, std::string short_name, 
@@ -106,9 +107,12 @@ Result<void> ArgParser::parse(std::span<const char*> args) {
     }
     
     // Check required positional arguments
-    if (positional_values_.size() < positional_names_.size()) {
-        return Result<void>(std::format("Missing required argument: {}", 
-            positional_names_[positional_values_.size()]));
+    size_t required_seen = 0;
+    for (size_t i = 0; i < positional_names_.size(); ++i) {
+        if (positional_required_[i] && required_seen++ == positional_values_.size()) {
+            return Result<void>(std::format("Missing required argument: {}", 
+                positional_names_[i]));
+        }
     }
     
     return Result<void>();
@@ -171,8 +175,9 @@ std::string ArgParser::help() const {
     oss << description_ << "\n\n";
     
     oss << "Usage: netprobe [options]";
-    for (const auto& pos : positional_names_) {
-        oss << " <" << pos << ">";
+    for (size_t i = 0; i < positional_names_.size(); ++i) {
+        oss << (positional_required_[i] ? " <" : " [") << positional_names_[i]
+            << (positional_required_[i] ? ">" : "]");
     }
     oss << "\n\n";
     
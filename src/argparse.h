@@ -15,8 +15,9 @@ class ArgParser {
 public:
     ArgParser(std::string_view description);
     
-    // Add positional argument
-    void add_positional(std::string name, std::string help);
+    // Add positional argument; optional ones are filled left to right
+    // only as far as the arguments given allow
+    void add_positional(std::string name, std::string help, bool required = true);
     
     // Add optional argument
     void add_option(std::string name, std::string short_name, std::string help, 
@@ -60,6 +61,7 @@ private:
     std::string description_;
     std::vector<std::string> positional_names_;
     std::vector<std::string> positional_help_;
+    std::vector<bool> positional_required_;
     std::vector<Option> options_;
     
     std::map<std::string, std::string> values_;
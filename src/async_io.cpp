@@ -1,120 +1,805 @@
 #include "async_io.h"
+#include <linux/io_uring.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdlib>
 #include <cstring>
 #include <format>
 
 namespace netprobe {
 
-AsyncIO::AsyncIO() {
-    epoll_fd_ = epoll_create1(0);
-    if (epoll_fd_ < 0) {
-        // Handle error silently - check in methods
+namespace {
+
+constexpr int MAX_EVENTS = 256;
+
+uint32_t to_epoll_events(AsyncIO::Event events) {
+    uint32_t result = 0;
+    
+    if (static_cast<int>(events) & static_cast<int>(AsyncIO::Event::READ)) {
+        result |= EPOLLIN;
+    }
+    if (static_cast<int>(events) & static_cast<int>(AsyncIO::Event::WRITE)) {
+        result |= EPOLLOUT;
     }
+    
+    return result;
+}
+
+// epoll user data: generation in the high half, fd in the low half
+uint64_t pack(int fd, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
 }
 
-AsyncIO::~AsyncIO() {
-    if (epoll_fd_ >= 0) {
-        ::close(epoll_fd_);
+// epoll_pwait2 (Linux 5.11) takes a timespec, so a timer wakeup lands on
+// its tick instead of being rounded up to the next whole millisecond
+int wait_for_events(int epoll_fd, epoll_event* events, int max, duration wait) {
+    static std::atomic<bool> have_pwait2{true};
+    
+    if (have_pwait2.load(std::memory_order_relaxed)) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+        timespec ts{ns / 1000000000, ns % 1000000000};
+        int n = epoll_pwait2(epoll_fd, events, max, &ts, nullptr);
+        if (n >= 0 || errno != ENOSYS) return n;
+        have_pwait2.store(false, std::memory_order_relaxed);
     }
+    
+    return epoll_wait(epoll_fd, events, max, 
+        static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(wait).count()));
 }
 
-Result<void> AsyncIO::add(int fd, Event events, Callback callback) {
-    if (epoll_fd_ < 0) {
-        return Result<void>("AsyncIO not initialized");
+} // anonymous namespace
+
+TimerWheel::TimerWheel(time_point origin) : origin_(origin) {
+    heads_.fill(NIL);
+    earliest_.fill(time_point::max());
+}
+
+TimerWheel::TimerId TimerWheel::schedule_at(time_point deadline, Callback callback) {
+    uint32_t index;
+    if (!free_.empty()) {
+        index = free_.back();
+        free_.pop_back();
+    } else {
+        index = static_cast<uint32_t>(timers_.size());
+        timers_.emplace_back();
+    }
+    
+    uint64_t tick = 0;
+    if (deadline > origin_) {
+        tick = std::chrono::floor<std::chrono::milliseconds>(deadline - origin_).count();
     }
     
-    struct epoll_event ev{};
-    ev.events = 0;
+    auto& timer = timers_[index];
+    timer.deadline = deadline;
+    timer.expires = tick;
+    timer.generation = next_generation_++;
+    if (next_generation_ == 0) next_generation_ = 1;
+    timer.callback = std::move(callback);
+    link(index);
+    ++active_;
+    
+    return (static_cast<uint64_t>(timer.generation) << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    uint32_t index = static_cast<uint32_t>(id & 0xFFFFFFFF);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+    
+    if (index >= timers_.size()) return false;
+    auto& timer = timers_[index];
+    if (timer.list == NIL || timer.generation != generation) return false;
+    
+    unlink(index);
+    release(index);
+    return true;
+}
+
+size_t TimerWheel::advance(time_point now) {
+    if (now < origin_) return 0;
+    uint64_t target = std::chrono::floor<std::chrono::milliseconds>(now - origin_).count();
+    size_t fired = 0;
     
-    if (static_cast<int>(events) & static_cast<int>(Event::READ)) {
-        ev.events |= EPOLLIN;
+    while (current_ <= target) {
+        if (active_ == 0) {
+            current_ = target;
+            break;
+        }
+        
+        uint32_t index = current_ & SLOT_MASK;
+        if (index == 0) {
+            // The first level wrapped: pull the next range down from above
+            for (int level = 1; level < LEVELS; ++level) {
+                uint32_t slot = (current_ >> (level * SLOT_BITS)) & SLOT_MASK;
+                cascade(level, slot);
+                if (slot != 0) break;
+            }
+        }
+        
+        if (heads_[index] == NIL) {
+            if (current_ == target) break;
+            
+            // Skip to the next occupied slot or the next wrap
+            current_ = std::min(current_ + (next_occupied(index) - index), target);
+            continue;
+        }
+        
+        // Detach the due timers first; callbacks may schedule or cancel
+        // timers. Every timer of a past tick is due, and of the tick under
+        // way those whose deadline has passed; the rest stay, and the
+        // wheel stays on this tick until it is over.
+        bool partial = current_ == target;
+        time_point earliest = time_point::max();
+        for (uint32_t i = heads_[index]; i != NIL;) {
+            uint32_t next = timers_[i].next;
+            if (partial && timers_[i].deadline > now) {
+                earliest = std::min(earliest, timers_[i].deadline);
+            } else {
+                unlink(i);
+                auto& timer = timers_[i];
+                timer.list = EXPIRED;
+                timer.next = heads_[EXPIRED];
+                if (timer.next != NIL) {
+                    timers_[timer.next].prev = i;
+                }
+                heads_[EXPIRED] = i;
+            }
+            i = next;
+        }
+        earliest_[index] = earliest;
+        if (!partial) ++current_;
+        
+        while (heads_[EXPIRED] != NIL) {
+            uint32_t i = heads_[EXPIRED];
+            unlink(i);
+            Callback callback = std::move(timers_[i].callback);
+            release(i);
+            ++fired;
+            callback();
+        }
+        
+        if (partial) break;
     }
-    if (static_cast<int>(events) & static_cast<int>(Event::WRITE)) {
-        ev.events |= EPOLLOUT;
+    
+    return fired;
+}
+
+time_point TimerWheel::next_deadline() const {
+    if (active_ == 0) return time_point::max();
+    
+    uint32_t index = current_ & SLOT_MASK;
+    uint32_t slot = next_occupied(index);
+    if (slot < SLOTS) {
+        return earliest_[slot];
     }
+    return origin_ + std::chrono::milliseconds(current_ - index + SLOTS);
+}
+
+void TimerWheel::link(uint32_t index) {
+    auto& timer = timers_[index];
     
-    size_t index = events_.size();
-    ev.data.u64 = index;
+    // Overdue timers go in the slot processed next
+    uint64_t expires = std::max(timer.expires, current_);
+    uint64_t delta = expires - current_;
     
-    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
-        return Result<void>(std::format("epoll_ctl ADD failed: {}", 
-            std::strerror(errno)));
+    uint32_t list;
+    if (delta < (1ull << SLOT_BITS)) {
+        list = expires & SLOT_MASK;
+        occupied_[list / 64] |= 1ull << (list % 64);
+        earliest_[list] = std::min(earliest_[list], timer.deadline);
+    } else if (delta < (1ull << (2 * SLOT_BITS))) {
+        list = SLOTS + ((expires >> SLOT_BITS) & SLOT_MASK);
+    } else if (delta < (1ull << (3 * SLOT_BITS))) {
+        list = 2 * SLOTS + ((expires >> (2 * SLOT_BITS)) & SLOT_MASK);
+    } else {
+        // Clamp to the wheel's range
+        if (delta >= (1ull << (4 * SLOT_BITS))) {
+            expires = current_ + (1ull << (4 * SLOT_BITS)) - 1;
+            timer.expires = expires;
+        }
+        list = 3 * SLOTS + ((expires >> (3 * SLOT_BITS)) & SLOT_MASK);
     }
     
-    events_.push_back({fd, std::move(callback)});
-    return Result<void>();
+    timer.list = list;
+    timer.prev = NIL;
+    timer.next = heads_[list];
+    if (timer.next != NIL) {
+        timers_[timer.next].prev = index;
+    }
+    heads_[list] = index;
 }
 
-Result<void> AsyncIO::modify(int fd, Event events) {
-    if (epoll_fd_ < 0) {
-        return Result<void>("AsyncIO not initialized");
+void TimerWheel::unlink(uint32_t index) {
+    auto& timer = timers_[index];
+    
+    if (timer.prev != NIL) {
+        timers_[timer.prev].next = timer.next;
+    } else {
+        heads_[timer.list] = timer.next;
+        if (timer.next == NIL && timer.list < SLOTS) {
+            occupied_[timer.list / 64] &= ~(1ull << (timer.list % 64));
+            earliest_[timer.list] = time_point::max();
+        }
+    }
+    if (timer.next != NIL) {
+        timers_[timer.next].prev = timer.prev;
     }
     
-    struct epoll_event ev{};
-    ev.events = 0;
+    timer.prev = timer.next = NIL;
+}
+
+void TimerWheel::release(uint32_t index) {
+    auto& timer = timers_[index];
+    timer.list = NIL;
+    timer.callback = nullptr;
+    free_.push_back(index);
+    --active_;
+}
+
+void TimerWheel::cascade(int level, uint32_t slot) {
+    uint32_t list = level * SLOTS + slot;
+    uint32_t i = heads_[list];
+    heads_[list] = NIL;
     
-    if (static_cast<int>(events) & static_cast<int>(Event::READ)) {
-        ev.events |= EPOLLIN;
+    while (i != NIL) {
+        uint32_t next = timers_[i].next;
+        link(i);
+        i = next;
     }
-    if (static_cast<int>(events) & static_cast<int>(Event::WRITE)) {
-        ev.events |= EPOLLOUT;
+}
+
+// First occupied first-level slot at or after `from`; SLOTS if none
+uint32_t TimerWheel::next_occupied(uint32_t from) const {
+    for (uint32_t word = from / 64; word < occupied_.size(); ++word) {
+        uint64_t bits = occupied_[word];
+        if (word == from / 64) {
+            bits &= ~0ull << (from % 64);
+        }
+        if (bits) {
+            return word * 64 + std::countr_zero(bits);
+        }
     }
+    return SLOTS;
+}
+
+// Kernel readiness source behind AsyncIO. `data` is echoed back with each
+// ready event; masks use the poll(2) bits, which epoll shares.
+class AsyncIO::Poller {
+public:
+    struct Ready {
+        uint64_t data;
+        uint32_t events;
+    };
     
-    // Find event data
-    auto it = std::ranges::find_if(events_, [fd](const auto& e) { return e.fd == fd; });
-    if (it == events_.end()) {
-        return Result<void>("Socket not registered");
+    virtual ~Poller() = default;
+    
+    virtual Result<void> add(int fd, uint32_t events, uint64_t data) = 0;
+    virtual Result<void> modify(int fd, uint32_t events, uint64_t data) = 0;
+    virtual Result<void> remove(int fd) = 0;
+    virtual int wait(Ready* ready, int max, duration timeout) = 0;
+    
+    uint64_t syscalls = 0;
+};
+
+class AsyncIO::EpollPoller final : public Poller {
+public:
+    EpollPoller() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)) {}
+    
+    ~EpollPoller() override {
+        if (epoll_fd_ >= 0) {
+            ::close(epoll_fd_);
+        }
     }
     
-    ev.data.u64 = std::distance(events_.begin(), it);
+    bool valid() const { return epoll_fd_ >= 0; }
     
-    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) < 0) {
-        return Result<void>(std::format("epoll_ctl MOD failed: {}", 
-            std::strerror(errno)));
+    Result<void> add(int fd, uint32_t events, uint64_t data) override {
+        return control(EPOLL_CTL_ADD, fd, events, data, "ADD");
     }
     
+    Result<void> modify(int fd, uint32_t events, uint64_t data) override {
+        return control(EPOLL_CTL_MOD, fd, events, data, "MOD");
+    }
+    
+    Result<void> remove(int fd) override {
+        ++syscalls;
+        
+        // A closed fd has already left the interest list
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr) < 0 && 
+            errno != EBADF && errno != ENOENT) {
+            return Result<void>(std::format("epoll_ctl DEL failed: {}", 
+                std::strerror(errno)));
+        }
+        return Result<void>();
+    }
+    
+    int wait(Ready* ready, int max, duration timeout) override {
+        epoll_event events[MAX_EVENTS];
+        ++syscalls;
+        
+        int n = wait_for_events(epoll_fd_, events, std::min<int>(max, MAX_EVENTS), timeout);
+        for (int i = 0; i < n; ++i) {
+            ready[i] = {events[i].data.u64, events[i].events};
+        }
+        return n;
+    }
+
+private:
+    Result<void> control(int op, int fd, uint32_t events, uint64_t data, const char* name) {
+        struct epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = data;
+        ++syscalls;
+        
+        if (epoll_ctl(epoll_fd_, op, fd, &ev) < 0) {
+            return Result<void>(std::format("epoll_ctl {} failed: {}", 
+                name, std::strerror(errno)));
+        }
+        return Result<void>();
+    }
+    
+    int epoll_fd_;
+};
+
+// io_uring readiness via one-shot IORING_OP_POLL_ADD requests. A one-shot
+// poll completes at once if the fd is already ready, so re-arming after
+// each event gives epoll's level-triggered behaviour. Arms, re-arms and
+// cancellations only fill SQEs; they reach the kernel with the next wait,
+// batching a whole loop iteration into one io_uring_enter.
+//
+// Rings are driven with raw syscalls, so liburing is not needed.
+class AsyncIO::UringPoller final : public Poller {
+public:
+    // Returns nullptr if the kernel lacks io_uring or the features we need
+    static std::unique_ptr<UringPoller> create() {
+        auto poller = std::unique_ptr<UringPoller>(new UringPoller());
+        return poller->init() ? std::move(poller) : nullptr;
+    }
+    
+    ~UringPoller() override {
+        if (sqes_ != MAP_FAILED) ::munmap(sqes_, sqes_size_);
+        if (ring_ != MAP_FAILED) ::munmap(ring_, ring_size_);
+        if (ring_fd_ >= 0) ::close(ring_fd_);
+    }
+    
+    Result<void> add(int fd, uint32_t events, uint64_t data) override {
+        if (static_cast<size_t>(fd) >= entries_.size()) {
+            entries_.resize(std::max<size_t>(fd + 1, entries_.size() * 2));
+        }
+        
+        // Keep seq counting across registrations of the same fd number
+        auto& entry = entries_[fd];
+        entry.data = data;
+        entry.events = events;
+        entry.registered = true;
+        arm(fd);
+        return Result<void>();
+    }
+    
+    Result<void> modify(int fd, uint32_t events, uint64_t data) override {
+        auto& entry = entries_[fd];
+        entry.data = data;
+        entry.events = events;
+        
+        // Narrowing the mask keeps the outstanding poll and filters what it
+        // reports; only a wider mask needs a new request. A fired entry is
+        // re-armed with the new mask on the next wait.
+        if (entry.armed && (events & ~entry.armed_events)) {
+            disarm(fd);
+            arm(fd);
+        }
+        return Result<void>();
+    }
+    
+    Result<void> remove(int fd) override {
+        if (static_cast<size_t>(fd) < entries_.size()) {
+            entries_[fd].registered = false;
+            disarm(fd);
+        }
+        return Result<void>();
+    }
+    
+    int wait(Ready* ready, int max, duration timeout) override {
+        // Walk copies: arm() and cancel() queue whatever they cannot
+        // submit again. Swapping keeps both vectors' capacity.
+        retry_fds_.swap(fired_);
+        for (int fd : retry_fds_) {
+            auto& entry = entries_[fd];
+            if (entry.registered && !entry.armed) {
+                arm(fd);
+            }
+        }
+        retry_fds_.clear();
+        
+        retry_cancels_.swap(cancels_);
+        for (uint64_t request : retry_cancels_) {
+            cancel(request);
+        }
+        retry_cancels_.clear();
+        
+        if (completions() == 0) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+            __kernel_timespec ts{ns / 1000000000, ns % 1000000000};
+            io_uring_getevents_arg arg{};
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            
+            if (enter(pending(), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                      &arg, sizeof(arg)) < 0 && 
+                errno != ETIME && errno != EINTR && errno != EBUSY) {
+                return -1;
+            }
+        } else if (pending() > 0) {
+            enter(pending(), 0, 0, nullptr, 0);
+        }
+        
+        return reap(ready, max);
+    }
+
+private:
+    static constexpr unsigned RING_ENTRIES = 1024;
+    static constexpr uint64_t CANCEL_TAG = UINT64_MAX;
+    
+    struct Entry {
+        uint64_t data = 0;
+        uint32_t events = 0;
+        uint32_t armed_events = 0;  // Mask of the outstanding poll request
+        uint32_t seq = 0;           // Tags the outstanding poll request
+        bool registered = false;
+        bool armed = false;
+    };
+    
+    UringPoller() = default;
+    
+    static uint64_t tag(int fd, uint32_t seq) {
+        return (static_cast<uint64_t>(seq) << 32) | static_cast<uint32_t>(fd);
+    }
+    
+    bool init() {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+        params.cq_entries = RING_ENTRIES * 4;
+        ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+        
+        if (ring_fd_ < 0 && errno == EINVAL) {
+            // COOP_TASKRUN needs 5.19
+            params = {};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = RING_ENTRIES * 4;
+            ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+        }
+        if (ring_fd_ < 0) return false;
+        
+        // EXT_ARG (5.11) gives io_uring_enter a timeout; SINGLE_MMAP and
+        // NODROP come with it
+        constexpr uint32_t required = IORING_FEAT_EXT_ARG | IORING_FEAT_SINGLE_MMAP | 
+                                      IORING_FEAT_NODROP;
+        if ((params.features & required) != required) return false;
+        
+        ring_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                              params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        ring_ = ::mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, 
+                       MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (ring_ == MAP_FAILED) return false;
+        
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+        
+        auto* base = static_cast<char*>(ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+        sq_array_ = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+        sq_mask_ = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        cq_head_ = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+        sq_local_tail_ = *sq_tail_;
+        return true;
+    }
+    
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, 
+              void* arg, size_t arg_size) {
+        std::atomic_ref<unsigned>(*sq_tail_).store(sq_local_tail_, std::memory_order_release);
+        ++syscalls;
+        return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, to_submit, 
+            min_complete, flags, arg, arg_size));
+    }
+    
+    unsigned pending() const {
+        return sq_local_tail_ - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+    }
+    
+    unsigned completions() const {
+        return std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire) - *cq_head_;
+    }
+    
+    // Next free SQE, flushing the queue to the kernel if it is full
+    io_uring_sqe* next_sqe() {
+        if (pending() >= sq_entries_) {
+            enter(pending(), 0, 0, nullptr, 0);
+            if (pending() >= sq_entries_) return nullptr;
+        }
+        
+        unsigned index = sq_local_tail_ & sq_mask_;
+        sq_array_[index] = index;
+        ++sq_local_tail_;
+        
+        auto* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+    
+    void arm(int fd) {
+        auto* sqe = next_sqe();
+        if (!sqe) {
+            // Retried on the next wait
+            fired_.push_back(fd);
+            return;
+        }
+        
+        auto& entry = entries_[fd];
+        ++entry.seq;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = entry.events;
+        sqe->user_data = tag(fd, entry.seq);
+        entry.armed = true;
+        entry.armed_events = entry.events;
+    }
+    
+    // Cancel the outstanding poll; a completion that still arrives for it
+    // carries a stale seq and is ignored
+    void disarm(int fd) {
+        auto& entry = entries_[fd];
+        if (!entry.armed) return;
+        entry.armed = false;
+        cancel(tag(fd, entry.seq));
+    }
+    
+    // Until it is removed the poll holds a reference to the file, even
+    // after the fd is closed, so a removal that finds the queue full is
+    // retried on the next wait rather than dropped
+    void cancel(uint64_t request) {
+        auto* sqe = next_sqe();
+        if (!sqe) {
+            cancels_.push_back(request);
+            return;
+        }
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = request;
+        sqe->user_data = CANCEL_TAG;
+    }
+    
+    int reap(Ready* ready, int max) {
+        unsigned head = *cq_head_;
+        unsigned tail = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+        int n = 0;
+        
+        while (head != tail && n < max) {
+            const auto& cqe = cqes_[head & cq_mask_];
+            ++head;
+            if (cqe.user_data == CANCEL_TAG) continue;
+            
+            int fd = static_cast<int>(cqe.user_data & 0xFFFFFFFF);
+            uint32_t seq = static_cast<uint32_t>(cqe.user_data >> 32);
+            if (static_cast<size_t>(fd) >= entries_.size()) continue;
+            
+            auto& entry = entries_[fd];
+            if (!entry.armed || entry.seq != seq) continue;
+            
+            entry.armed = false;
+            fired_.push_back(fd);
+            
+            // Drop readiness the caller has since stopped asking for
+            uint32_t events = cqe.res < 0 ? EPOLLERR : static_cast<uint32_t>(cqe.res);
+            events &= entry.events | EPOLLERR | EPOLLHUP;
+            if (events) {
+                ready[n++] = {entry.data, events};
+            }
+        }
+        
+        std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+        return n;
+    }
+    
+    int ring_fd_ = -1;
+    void* ring_ = MAP_FAILED;
+    size_t ring_size_ = 0;
+    io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size_ = 0;
+    
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sq_local_tail_ = 0;
+    
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    
+    std::vector<Entry> entries_;
+    std::vector<int> fired_;        // Completed polls awaiting re-arm
+    std::vector<uint64_t> cancels_; // Poll removals awaiting a free SQE
+    std::vector<int> retry_fds_;
+    std::vector<uint64_t> retry_cancels_;
+};
+
+AsyncIO::AsyncIO(Backend backend) {
+    if (backend == Backend::AUTO) {
+        const char* env = std::getenv("NETPROBE_IO_BACKEND");
+        backend = env ? parse_backend(env).value_or(Backend::AUTO) : Backend::AUTO;
+    }
+    
+    // io_uring poll requests match epoll on throughput but cancel slowly
+    // with many fds outstanding, which hurts connect-heavy workloads, so
+    // it is opt-in
+    if (backend == Backend::IO_URING) {
+        if (auto uring = UringPoller::create()) {
+            poller_ = std::move(uring);
+            backend_ = Backend::IO_URING;
+            return;
+        }
+    }
+    
+    // Methods report "not initialized" if this fails too
+    auto epoll = std::make_unique<EpollPoller>();
+    if (epoll->valid()) {
+        poller_ = std::move(epoll);
+    }
+    backend_ = Backend::EPOLL;
+}
+
+AsyncIO::~AsyncIO() = default;
+
+const char* AsyncIO::backend_name(Backend backend) {
+    switch (backend) {
+        case Backend::AUTO: return "auto";
+        case Backend::EPOLL: return "epoll";
+        case Backend::IO_URING: return "io_uring";
+    }
+    return "unknown";
+}
+
+std::optional<AsyncIO::Backend> AsyncIO::parse_backend(std::string_view name) {
+    for (auto backend : {Backend::AUTO, Backend::EPOLL, Backend::IO_URING}) {
+        if (name == backend_name(backend)) return backend;
+    }
+    return std::nullopt;
+}
+
+uint64_t AsyncIO::syscalls() const {
+    return poller_ ? poller_->syscalls : 0;
+}
+
+AsyncIO::Handler* AsyncIO::find(int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) >= handlers_.size()) return nullptr;
+    auto& handler = handlers_[fd];
+    return handler.active ? &handler : nullptr;
+}
+
+Result<void> AsyncIO::add(int fd, Event events, Callback callback) {
+    if (!poller_) {
+        return Result<void>("AsyncIO not initialized");
+    }
+    if (fd < 0) {
+        return Result<void>("Invalid file descriptor");
+    }
+    
+    if (static_cast<size_t>(fd) >= handlers_.size()) {
+        handlers_.resize(std::max<size_t>(fd + 1, handlers_.size() * 2));
+    }
+    
+    if (handlers_[fd].active) {
+        return Result<void>("Socket already registered");
+    }
+    
+    uint32_t generation = next_generation_++;
+    if (next_generation_ == 0) next_generation_ = 1;
+    
+    auto res = poller_->add(fd, to_epoll_events(events), pack(fd, generation));
+    if (!res) {
+        return res;
+    }
+    
+    uint32_t slot;
+    if (!free_slots_.empty()) {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        callbacks_[slot] = std::move(callback);
+    } else {
+        slot = static_cast<uint32_t>(callbacks_.size());
+        callbacks_.push_back(std::move(callback));
+    }
+    
+    handlers_[fd] = {generation, slot, true};
+    ++registered_;
     return Result<void>();
 }
 
+Result<void> AsyncIO::modify(int fd, Event events) {
+    if (!poller_) {
+        return Result<void>("AsyncIO not initialized");
+    }
+    
+    auto* handler = find(fd);
+    if (!handler) {
+        return Result<void>("Socket not registered");
+    }
+    
+    return poller_->modify(fd, to_epoll_events(events), pack(fd, handler->generation));
+}
+
 Result<void> AsyncIO::remove(int fd) {
-    if (epoll_fd_ < 0) {
+    if (!poller_) {
         return Result<void>("AsyncIO not initialized");
     }
     
-    if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr) < 0) {
-        return Result<void>(std::format("epoll_ctl DEL failed: {}", 
-            std::strerror(errno)));
+    auto* handler = find(fd);
+    if (!handler) {
+        return Result<void>("Socket not registered");
     }
     
-    // Remove from events vector
-    auto it = std::ranges::find_if(events_, [fd](const auto& e) { return e.fd == fd; });
-    if (it != events_.end()) {
-        events_.erase(it);
+    // Drop the handler even if the kernel side fails
+    auto res = poller_->remove(fd);
+    
+    handler->active = false;
+    if (dispatching_) {
+        retired_slots_.push_back(handler->slot);
+    } else {
+        release_slot(handler->slot);
     }
+    --registered_;
     
-    return Result<void>();
+    return res;
+}
+
+void AsyncIO::release_slot(uint32_t slot) {
+    callbacks_[slot] = nullptr;
+    free_slots_.push_back(slot);
 }
 
 void AsyncIO::run_once(std::chrono::milliseconds timeout) {
-    if (epoll_fd_ < 0) return;
+    if (!poller_) return;
+    
+    Poller::Ready events[MAX_EVENTS];
     
-    constexpr size_t MAX_EVENTS = 64;
-    struct epoll_event events[MAX_EVENTS];
+    // Never sleep past the next timer
+    duration wait = timeout;
+    auto next_timer = timers_.next_deadline();
+    if (next_timer != time_point::max()) {
+        wait = std::clamp<duration>(next_timer - steady_clock::now(), 0ns, wait);
+    }
     
-    int nfds = epoll_wait(epoll_fd_, events, MAX_EVENTS, 
-        static_cast<int>(timeout.count()));
+    int nfds = poller_->wait(events, MAX_EVENTS, wait);
     
     if (nfds < 0) {
         if (errno != EINTR) {
             // Error occurred
         }
-        return;
+        nfds = 0;
     }
     
+    dispatching_ = true;
+    
     for (int i = 0; i < nfds; ++i) {
-        size_t index = events[i].data.u64;
-        if (index >= events_.size()) continue;
+        int fd = static_cast<int>(events[i].data & 0xFFFFFFFF);
+        uint32_t generation = static_cast<uint32_t>(events[i].data >> 32);
+        
+        // Stale if the fd was removed or re-registered earlier in this batch
+        auto* handler = find(fd);
+        if (!handler || handler->generation != generation) continue;
         
         Event event_type = Event::READ;
         if (events[i].events & EPOLLIN) {
@@ -125,8 +810,16 @@ void AsyncIO::run_once(std::chrono::milliseconds timeout) {
             event_type = Event::ERROR;
         }
         
-        events_[index].callback(events_[index].fd, event_type);
+        callbacks_[handler->slot](fd, event_type);
     }
+    
+    dispatching_ = false;
+    for (uint32_t slot : retired_slots_) {
+        release_slot(slot);
+    }
+    retired_slots_.clear();
+    
+    timers_.advance(steady_clock::now());
 }
 
 void AsyncIO::run() {
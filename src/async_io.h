@@ -2,12 +2,106 @@
 
 #include "common.h"
 #include "socket.h"
+#include <array>
 #include <functional>
+#include <memory>
+#include <deque>
 #include <vector>
 
 namespace netprobe {
 
-// Async I/O event loop
+// Hierarchical timer wheel.
+//
+// Four levels of 256 slots at 1ms resolution cover about 49 days. Timers
+// sit in intrusive doubly-linked slot lists, so schedule and cancel are
+// O(1); a timer beyond the first level is cascaded one level down each
+// time the level below it wraps, so it moves at most three times before
+// it fires. A timer sits in the tick its deadline falls in and keeps the
+// exact deadline: within the tick under way only those whose deadline
+// has passed fire, and each first-level slot knows its earliest deadline.
+// Timers never fire early, and are late only by the wait that wakes for
+// them, not by a tick.
+class TimerWheel {
+public:
+    using Callback = std::function<void()>;
+    using TimerId = uint64_t;
+    
+    // Never returned by schedule(); safe to cancel
+    static constexpr TimerId INVALID_TIMER = 0;
+    
+    explicit TimerWheel(time_point origin = steady_clock::now());
+    
+    TimerId schedule_at(time_point deadline, Callback callback);
+    TimerId schedule(duration delay, Callback callback) {
+        return schedule_at(steady_clock::now() + delay, std::move(callback));
+    }
+    
+    // Returns false if the timer already fired or was cancelled
+    bool cancel(TimerId id);
+    
+    // Fire every timer due at `now`; returns the number fired
+    size_t advance(time_point now);
+    
+    // Earliest time the wheel needs attention: the earliest deadline in
+    // the next occupied slot, or the next cascade if only later levels
+    // hold timers. time_point::max() when empty.
+    time_point next_deadline() const;
+    
+    size_t size() const { return active_; }
+    bool empty() const { return active_ == 0; }
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 8;
+    static constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+    static constexpr uint32_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint32_t NIL = UINT32_MAX;
+    
+    // List holding the timers of the tick being fired
+    static constexpr uint32_t EXPIRED = LEVELS * SLOTS;
+    
+    struct Timer {
+        time_point deadline{};
+        uint64_t expires = 0;       // The tick the deadline falls in
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        uint32_t list = NIL;        // NIL while the timer is free
+        uint32_t generation = 0;
+        Callback callback;
+    };
+    
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void cascade(int level, uint32_t slot);
+    uint32_t next_occupied(uint32_t from) const;
+    
+    time_point origin_;
+    uint64_t current_ = 0;          // Tick under way; earlier ones are done
+    std::vector<Timer> timers_;
+    std::vector<uint32_t> free_;
+    std::array<uint32_t, LEVELS * SLOTS + 1> heads_;
+    std::array<uint64_t, SLOTS / 64> occupied_{};   // Non-empty first-level slots
+    
+    // No later than the earliest deadline in each first-level slot. A
+    // cancel may leave it early, which costs one wakeup within that tick.
+    std::array<time_point, SLOTS> earliest_;
+    uint32_t next_generation_ = 1;
+    size_t active_ = 0;
+};
+
+// Async I/O event loop.
+//
+// Handlers live in a table indexed by fd, so add/modify/remove and
+// dispatch are O(1) regardless of how many sockets are registered. Each
+// registration gets a generation number that travels with the kernel
+// event, so an event still queued for an fd that was removed (and perhaps
+// re-added) within the same batch is dropped instead of misdelivered.
+//
+// Readiness comes from epoll or from io_uring poll requests; both are
+// level-triggered. With io_uring, registration changes are queued and
+// submitted together with the next wait, so a loop iteration costs one
+// syscall however many fds it re-arms or modifies.
 class AsyncIO {
 public:
     enum class Event {
@@ -16,31 +110,87 @@ public:
         ERROR = 4
     };
     
+    // AUTO honours NETPROBE_IO_BACKEND=epoll|io_uring and defaults to
+    // epoll. io_uring falls back to epoll where the kernel lacks it.
+    enum class Backend {
+        AUTO,
+        EPOLL,
+        IO_URING
+    };
+    
     using Callback = std::function<void(int fd, Event event)>;
+    using TimerId = TimerWheel::TimerId;
     
-    AsyncIO();
+    explicit AsyncIO(Backend backend = Backend::AUTO);
     ~AsyncIO();
     
+    AsyncIO(const AsyncIO&) = delete;
+    AsyncIO& operator=(const AsyncIO&) = delete;
+    
+    // Backend actually in use (never AUTO)
+    Backend backend() const { return backend_; }
+    static const char* backend_name(Backend backend);
+    static std::optional<Backend> parse_backend(std::string_view name);
+    
+    // Reactor syscalls issued so far (waits and registration changes)
+    uint64_t syscalls() const;
+    
     // Register socket for events
     Result<void> add(int fd, Event events, Callback callback);
     Result<void> modify(int fd, Event events);
     Result<void> remove(int fd);
     
+    // One-shot timers, fired from the event loop. The epoll wait never
+    // outlasts the next deadline, so timers fire without extra sleeping.
+    TimerId schedule(duration delay, TimerWheel::Callback callback) {
+        return timers_.schedule(delay, std::move(callback));
+    }
+    TimerId schedule_at(time_point deadline, TimerWheel::Callback callback) {
+        return timers_.schedule_at(deadline, std::move(callback));
+    }
+    bool cancel(TimerId id) { return timers_.cancel(id); }
+    
     // Run event loop
     void run_once(std::chrono::milliseconds timeout = 100ms);
     void run();
     void stop();
+    
+    // Number of registered fds
+    size_t size() const { return registered_; }
+    size_t timer_count() const { return timers_.size(); }
 
 private:
-    int epoll_fd_ = -1;
+    class Poller;
+    class EpollPoller;
+    class UringPoller;
+    
+    std::unique_ptr<Poller> poller_;
+    Backend backend_ = Backend::EPOLL;
     bool running_ = false;
     
-    struct EventData {
-        int fd;
-        Callback callback;
+    struct Handler {
+        uint32_t generation = 0;
+        uint32_t slot = 0;
+        bool active = false;
     };
     
-    std::vector<EventData> events_;
+    Handler* find(int fd);
+    void release_slot(uint32_t slot);
+    
+    std::vector<Handler> handlers_;
+    uint32_t next_generation_ = 1;
+    size_t registered_ = 0;
+    
+    // Callbacks live in a slab whose elements never move (deque growth
+    // keeps references valid), so a running callback can add and remove
+    // fds freely. Slots freed during a dispatch batch are only recycled
+    // once the batch is done, since the callback may be removing itself.
+    std::deque<Callback> callbacks_;
+    std::vector<uint32_t> free_slots_;
+    std::vector<uint32_t> retired_slots_;
+    bool dispatching_ = false;
+    
+    TimerWheel timers_;
 };
 
 } // namespace netprobe
@@ -0,0 +1,138 @@
+#include "checkpoint.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+#include <format>
+#include <utility>
+
+namespace netprobe {
+
+namespace {
+
+constexpr char MAGIC[8] = {'N', 'P', 'S', 'C', 'A', 'N', '\0', '\1'};
+
+// Probe states per 64-bit word
+constexpr uint64_t PER_WORD = 32;
+
+} // anonymous namespace
+
+struct Checkpoint::Header {
+    char magic[8];
+    uint64_t digest;
+    uint64_t size;
+    uint64_t seed;
+};
+
+Result<Checkpoint> Checkpoint::open(const std::string& path, uint64_t digest,
+                                    uint64_t size, uint64_t seed) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return Result<Checkpoint>(std::format("Cannot open {}: {}", path, std::strerror(errno)));
+    }
+    
+    size_t length = sizeof(Header) + (size + PER_WORD - 1) / PER_WORD * sizeof(uint64_t);
+    struct stat st{};
+    bool created = fstat(fd, &st) == 0 && st.st_size == 0;
+    
+    if (created && ftruncate(fd, static_cast<off_t>(length)) != 0) {
+        ::close(fd);
+        return Result<Checkpoint>(std::format("Cannot size {}: {}", path, std::strerror(errno)));
+    }
+    if (!created && static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return Result<Checkpoint>(std::format("{} is not a scan checkpoint", path));
+    }
+    
+    void* base = mmap(nullptr, created ? length : static_cast<size_t>(st.st_size),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        return Result<Checkpoint>(std::format("Cannot map {}: {}", path, std::strerror(errno)));
+    }
+    
+    Checkpoint checkpoint;
+    checkpoint.base_ = base;
+    checkpoint.length_ = created ? length : static_cast<size_t>(st.st_size);
+    Header* header = checkpoint.header();
+    
+    if (created) {
+        header->digest = digest;
+        header->size = size;
+        header->seed = seed;
+        std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        return checkpoint;
+    }
+    
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) {
+        return Result<Checkpoint>(std::format("{} is not a scan checkpoint", path));
+    }
+    if (header->digest != digest || header->size != size || checkpoint.length_ != length) {
+        return Result<Checkpoint>(std::format("{} was saved by a scan of other targets or ports", path));
+    }
+    return checkpoint;
+}
+
+Checkpoint::~Checkpoint() {
+    unmap();
+}
+
+Checkpoint::Checkpoint(Checkpoint&& other) noexcept
+    : base_(std::exchange(other.base_, nullptr)), length_(std::exchange(other.length_, 0)) {}
+
+Checkpoint& Checkpoint::operator=(Checkpoint&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        base_ = std::exchange(other.base_, nullptr);
+        length_ = std::exchange(other.length_, 0);
+    }
+    return *this;
+}
+
+void Checkpoint::unmap() {
+    if (base_) {
+        munmap(base_, length_);
+        base_ = nullptr;
+    }
+}
+
+Checkpoint::Header* Checkpoint::header() const {
+    return static_cast<Header*>(base_);
+}
+
+uint64_t* Checkpoint::words() const {
+    return reinterpret_cast<uint64_t*>(static_cast<char*>(base_) + sizeof(Header));
+}
+
+uint64_t Checkpoint::seed() const {
+    return header()->seed;
+}
+
+uint64_t Checkpoint::size() const {
+    return header()->size;
+}
+
+Checkpoint::State Checkpoint::get(uint64_t index) const {
+    uint64_t word = std::atomic_ref(words()[index / PER_WORD]).load(std::memory_order_relaxed);
+    return static_cast<State>((word >> (index % PER_WORD * 2)) & 3);
+}
+
+void Checkpoint::set(uint64_t index, State state) {
+    // Other probes share the word, so clear and set only these two bits
+    std::atomic_ref word(words()[index / PER_WORD]);
+    uint64_t shift = index % PER_WORD * 2;
+    word.fetch_and(~(uint64_t{3} << shift), std::memory_order_relaxed);
+    word.fetch_or(static_cast<uint64_t>(state) << shift, std::memory_order_relaxed);
+}
+
+void Checkpoint::flush() {
+    if (base_) msync(base_, length_, MS_ASYNC);
+}
+
+void Checkpoint::sync() {
+    if (base_) msync(base_, length_, MS_SYNC);
+}
+
+} // namespace netprobe
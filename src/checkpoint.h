@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common.h"
+#include <string>
+
+namespace netprobe {
+
+// Progress of a scan kept in a memory-mapped file, so a scan that is
+// killed can pick up where it stopped.
+//
+// The file is a header naming the scan (a digest of what it probes, and
+// the seed of its probe order) followed by two bits of state per probe,
+// set as each probe completes. The mapping is shared, so the kernel keeps
+// every state written even if the process dies; flush() only starts the
+// write-back to disk. Probes still in flight at the time are pending
+// again on resume and get sent once more.
+class Checkpoint {
+public:
+    enum class State : uint8_t {
+        PENDING,
+        CLOSED,
+        FILTERED,
+        OPEN
+    };
+    
+    // The checkpoint at `path` for a scan of `size` probes identified by
+    // `digest`, created with `seed` if the file does not exist yet. A file
+    // left by a different scan is an error, not overwritten.
+    static Result<Checkpoint> open(const std::string& path, uint64_t digest,
+                                   uint64_t size, uint64_t seed);
+    
+    Checkpoint() = default;
+    ~Checkpoint();
+    
+    // Non-copyable, movable
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+    Checkpoint(Checkpoint&& other) noexcept;
+    Checkpoint& operator=(Checkpoint&& other) noexcept;
+    
+    bool is_open() const { return base_ != nullptr; }
+    uint64_t seed() const;
+    uint64_t size() const;
+    
+    // Safe to call from any thread, as long as only one thread sets a
+    // given probe's state; setting it again replaces it
+    State get(uint64_t index) const;
+    void set(uint64_t index, State state);
+    
+    // Start writing dirty pages back without waiting; sync() waits
+    void flush();
+    void sync();
+
+private:
+    struct Header;
+    
+    void unmap();
+    
+    Header* header() const;
+    uint64_t* words() const;
+    
+    void* base_ = nullptr;
+    size_t length_ = 0;
+};
+
+} // namespace netprobe
@@ -3,62 +3,400 @@
 #include "../stats.h"
 #include "../ansi.h"
 #include "../argparse.h"
+#include "../async_io.h"
+#include "../http.h"
+#include "../runtime.h"
 #include <iostream>
 #include <format>
 #include <thread>
 #include <vector>
+#include <algorithm>
+#include <memory>
 #include <atomic>
-#include <sstream>
+#include <sys/prctl.h>
+#include <sys/socket.h>
 
 namespace netprobe::commands {
 
 namespace {
 
-Result<std::pair<size_t, double>> http_request(std::string_view host, uint16_t port, 
-                                                std::string_view path) {
-    Socket sock(Socket::Type::TCP);
-    if (!sock.is_valid()) {
-        return Result<std::pair<size_t, double>>("Failed to create socket");
+constexpr size_t RECV_BUFFER_SIZE = 64 * 1024;
+constexpr auto CONNECT_TIMEOUT = 3s;
+
+// A connection that failed is reopened after a delay that doubles with
+// each failure in a row, so a server that is down is not hammered
+constexpr duration RETRY_MIN = 10ms;
+constexpr duration RETRY_MAX = 1s;
+
+// Shared, read-only run parameters
+struct BenchConfig {
+    sockaddr_in addr{};
+    std::string request;
+    size_t pipeline = 1;
+    time_point start;
+    time_point deadline;
+    
+    // Open-loop mode: each connection sends on a fixed schedule of one
+    // request per `interval`, independent of when responses come back
+    bool open_loop = false;
+    duration interval{};
+    size_t connections = 1;
+    
+    // Significant digits kept by the latency histograms
+    int precision = BucketLayout::DEFAULT_DIGITS;
+};
+
+// Per-reactor results. Only the reactor thread writes them; the main
+// thread drains the recorders and reads the counters once per reporting
+// interval and merges everything after the reactors stop.
+struct BenchResult {
+    explicit BenchResult(int precision) : latency(precision), service_time(precision) {}
+    
+    LatencyRecorder latency;       // From intended send time (corrected)
+    LatencyRecorder service_time;  // From actual send time, open-loop only
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> errors{0};
+};
+
+// Send times of one request: when the schedule wanted it to go out, and
+// when it actually did. They only differ in open-loop mode.
+struct SendTimes {
+    time_point intended;
+    time_point sent;
+};
+
+// Fixed-capacity FIFO of send times for the requests in flight on one
+// connection; responses arrive in request order (RFC 9112 9.3.2)
+class InflightQueue {
+public:
+    void init(size_t capacity) { slots_.resize(capacity); clear(); }
+    void clear() { head_ = 0; count_ = 0; }
+    
+    bool empty() const { return count_ == 0; }
+    bool full() const { return count_ == slots_.size(); }
+    size_t size() const { return count_; }
+    
+    void push(SendTimes t) {
+        slots_[(head_ + count_) % slots_.size()] = t;
+        ++count_;
     }
     
-    auto connect_result = sock.connect(host, port, 2000ms);
-    if (!connect_result) {
-        return Result<std::pair<size_t, double>>(connect_result.error);
+    SendTimes pop() {
+        SendTimes t = slots_[head_];
+        head_ = (head_ + 1) % slots_.size();
+        --count_;
+        return t;
     }
     
-    // Build HTTP request
-    std::string request = std::format(
-        "GET {} HTTP/1.1\r\n"
-        "Host: {}\r\n"
-        "Connection: close\r\n"
-        "User-Agent: NetProbe/1.0\r\n"
-        "\r\n",
-        path, host);
+    // Requests written again keep their intended times
+    void resent(time_point sent) {
+        for (size_t i = 0; i < count_; ++i) {
+            slots_[(head_ + i) % slots_.size()].sent = sent;
+        }
+    }
+
+private:
+    std::vector<SendTimes> slots_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+};
+
+// One reactor's share of the keep-alive connections.
+// Each connection keeps up to `pipeline` requests written ahead of the
+// responses and tops the window back up as responses complete, reusing
+// the socket until the server closes it.
+//
+// In open-loop mode the window only bounds how far a connection may fall
+// behind; requests are released on each connection's own timeline and
+// their latency is measured from the scheduled time, so a stalled server
+// is charged for the requests it delayed (wrk2-style correction for
+// coordinated omission). Scheduled sends, connect timeouts and the end of
+// the run are all reactor timers, so nothing polls.
+class BenchWorker {
+public:
+    BenchWorker(const BenchConfig& config, AsyncIO& io, size_t first_conn, size_t connections)
+        : config_(config), io_(io), conns_(connections), buffer_(RECV_BUFFER_SIZE),
+          result_(config.precision) {
+        for (size_t i = 0; i < conns_.size(); ++i) {
+            auto& conn = conns_[i];
+            conn.inflight.init(config_.pipeline);
+            conn.out.reserve(config_.pipeline * config_.request.size());
+            
+            // Stagger connection timelines so sends are spread evenly
+            conn.next_send = config_.start + 
+                config_.interval * (first_conn + i) / config_.connections;
+        }
+    }
+    
+    // Open the connections; the reactor stops itself at the deadline
+    void start() {
+        for (auto& conn : conns_) {
+            open(conn);
+        }
+        
+        io_.schedule_at(config_.deadline, [this] {
+            for (auto& conn : conns_) {
+                if (conn.sock.is_valid()) {
+                    io_.remove(conn.sock.fd());
+                }
+            }
+            io_.stop();
+        });
+    }
     
-    auto start = steady_clock::now();
+    BenchResult& result() { return result_; }
+
+private:
+    struct Connection {
+        Socket sock;
+        bool connected = false;
+        bool want_write = false;
+        time_point next_send;
+        AsyncIO::TimerId connect_timer = TimerWheel::INVALID_TIMER;
+        AsyncIO::TimerId send_timer = TimerWheel::INVALID_TIMER;
+        AsyncIO::TimerId retry_timer = TimerWheel::INVALID_TIMER;
+        duration backoff{};         // Zero until a failure, reset by a response
+        std::string out;
+        size_t out_offset = 0;
+        InflightQueue inflight;
+        HttpResponseParser parser;
+    };
     
-    auto send_result = sock.send(request.data(), request.size());
-    if (!send_result) {
-        return Result<std::pair<size_t, double>>(send_result.error);
+    void open(Connection& conn) {
+        conn.sock = Socket(Socket::Type::TCP);
+        conn.connected = false;
+        conn.want_write = true;
+        conn.out.clear();
+        conn.out_offset = 0;
+        conn.parser.reset();
+        
+        // Out of fds or ephemeral ports: tried again later like any other
+        // failure, so the connection's schedule is not silently dropped
+        if (!conn.sock.is_valid() || !conn.sock.start_connect(config_.addr)) {
+            conn.sock.close();
+            fail(conn);
+            return;
+        }
+        conn.sock.set_nodelay(true);
+        
+        auto res = io_.add(conn.sock.fd(), AsyncIO::Event::WRITE,
+            [this, &conn](int, AsyncIO::Event event) { on_event(conn, event); });
+        if (!res) {
+            conn.sock.close();
+            fail(conn);
+            return;
+        }
+        
+        conn.connect_timer = io_.schedule(CONNECT_TIMEOUT, [this, &conn] {
+            conn.connect_timer = TimerWheel::INVALID_TIMER;
+            fail(conn);
+        });
     }
     
-    // Receive response
-    char buffer[4096];
-    size_t total_bytes = 0;
+    // Reopen at once after an orderly close, or after the backoff once
+    // the connection has failed. Requests keep their intended times while
+    // it is down, so in open-loop mode the outage is charged to the server.
+    void reconnect(Connection& conn) {
+        io_.cancel(conn.connect_timer);
+        io_.cancel(conn.send_timer);
+        conn.connect_timer = conn.send_timer = TimerWheel::INVALID_TIMER;
+        
+        if (conn.sock.is_valid()) {
+            io_.remove(conn.sock.fd());
+            conn.sock.close();
+        }
+        if (steady_clock::now() >= config_.deadline) return;
+        
+        if (conn.backoff == duration::zero()) {
+            open(conn);
+            return;
+        }
+        io_.cancel(conn.retry_timer);
+        conn.retry_timer = io_.schedule(conn.backoff, [this, &conn] {
+            conn.retry_timer = TimerWheel::INVALID_TIMER;
+            if (steady_clock::now() < config_.deadline) open(conn);
+        });
+    }
     
-    while (true) {
-        auto recv_result = sock.recv(buffer, sizeof(buffer));
-        if (!recv_result || *recv_result == 0) {
-            break;
+    void fail(Connection& conn) {
+        result_.errors.fetch_add(1, std::memory_order_relaxed);
+        conn.backoff = conn.backoff == duration::zero()
+            ? RETRY_MIN : std::min<duration>(conn.backoff * 2, RETRY_MAX);
+        reconnect(conn);
+    }
+    
+    void on_event(Connection& conn, AsyncIO::Event event) {
+        if (event == AsyncIO::Event::ERROR) {
+            fail(conn);
+            return;
+        }
+        
+        if (!conn.connected) {
+            if (conn.sock.pending_error() != 0) {
+                fail(conn);
+                return;
+            }
+            conn.connected = true;
+            io_.cancel(conn.connect_timer);
+            conn.connect_timer = TimerWheel::INVALID_TIMER;
+            requeue(conn);
+            fill_pipeline(conn);
+            flush(conn);
+            return;
+        }
+        
+        // A READ event may mask a pending WRITE, so always try both
+        if (conn.out_offset < conn.out.size() && !flush(conn)) {
+            return;
+        }
+        if (event == AsyncIO::Event::READ) {
+            read_responses(conn);
         }
-        total_bytes += *recv_result;
     }
     
-    auto end = steady_clock::now();
-    auto latency = std::chrono::duration<double, std::milli>(end - start).count();
+    // Requests the last connection left unanswered go out again first.
+    // They keep the times they were meant to go out, so in open-loop mode
+    // the wait across the reconnect is charged to them.
+    void requeue(Connection& conn) {
+        for (size_t i = 0; i < conn.inflight.size(); ++i) {
+            conn.out += config_.request;
+        }
+        conn.inflight.resent(steady_clock::now());
+    }
     
-    return std::make_pair(total_bytes, latency);
-}
+    // Queue requests until the in-flight window is full or, in open-loop
+    // mode, until the connection has caught up with its schedule. A full
+    // window is refilled as responses complete; a caught-up connection
+    // arms a timer for its next scheduled send.
+    void fill_pipeline(Connection& conn) {
+        auto now = steady_clock::now();
+        if (now >= config_.deadline) return;
+        
+        while (!conn.inflight.full()) {
+            time_point intended = now;
+            if (config_.open_loop) {
+                if (conn.next_send > now) {
+                    arm_send_timer(conn);
+                    break;
+                }
+                intended = conn.next_send;
+                conn.next_send += config_.interval;
+            }
+            conn.out += config_.request;
+            conn.inflight.push({intended, now});
+        }
+    }
+    
+    void arm_send_timer(Connection& conn) {
+        if (conn.send_timer != TimerWheel::INVALID_TIMER) return;
+        
+        conn.send_timer = io_.schedule_at(conn.next_send, [this, &conn] {
+            conn.send_timer = TimerWheel::INVALID_TIMER;
+            fill_pipeline(conn);
+            flush(conn);
+        });
+    }
+    
+    // Write queued requests; returns false if the connection was dropped
+    bool flush(Connection& conn) {
+        while (conn.out_offset < conn.out.size()) {
+            ssize_t n = ::send(conn.sock.fd(), conn.out.data() + conn.out_offset,
+                conn.out.size() - conn.out_offset, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                fail(conn);
+                return false;
+            }
+            conn.out_offset += n;
+        }
+        
+        if (conn.out_offset == conn.out.size()) {
+            conn.out.clear();
+            conn.out_offset = 0;
+        }
+        
+        bool want_write = !conn.out.empty();
+        if (want_write != conn.want_write) {
+            conn.want_write = want_write;
+            io_.modify(conn.sock.fd(), want_write 
+                ? static_cast<AsyncIO::Event>(
+                    static_cast<int>(AsyncIO::Event::READ) | static_cast<int>(AsyncIO::Event::WRITE))
+                : AsyncIO::Event::READ);
+        }
+        return true;
+    }
+    
+    void read_responses(Connection& conn) {
+        while (true) {
+            ssize_t n = ::recv(conn.sock.fd(), buffer_.data(), buffer_.size(), 0);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                fail(conn);
+                return;
+            }
+            
+            if (n == 0) {
+                conn.parser.finish();
+                // Either way, the pipelined requests still unanswered are
+                // resent on the new connection
+                if (conn.parser.status() == HttpResponseParser::Status::COMPLETE) {
+                    complete(conn);
+                    reconnect(conn);
+                } else if (conn.parser.message_bytes() == 0) {
+                    // Server closed between responses
+                    reconnect(conn);
+                } else {
+                    fail(conn);
+                }
+                return;
+            }
+            
+            // One read may carry the tail of one response and several more
+            size_t pos = 0;
+            while (pos < static_cast<size_t>(n)) {
+                pos += conn.parser.feed(buffer_.data() + pos, n - pos);
+                
+                auto status = conn.parser.status();
+                if (status == HttpResponseParser::Status::ERROR || 
+                    (status == HttpResponseParser::Status::COMPLETE && conn.inflight.empty())) {
+                    fail(conn);
+                    return;
+                }
+                if (status == HttpResponseParser::Status::INCOMPLETE) break;
+                
+                bool keep_alive = conn.parser.keep_alive();
+                complete(conn);
+                if (!keep_alive) {
+                    reconnect(conn);
+                    return;
+                }
+                conn.parser.reset();
+            }
+        }
+        
+        fill_pipeline(conn);
+        flush(conn);
+    }
+    
+    void complete(Connection& conn) {
+        auto now = steady_clock::now();
+        auto times = conn.inflight.pop();
+        result_.latency.record_nanos(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - times.intended).count());
+        if (config_.open_loop) {
+            result_.service_time.record_nanos(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - times.sent).count());
+        }
+        result_.bytes.fetch_add(conn.parser.message_bytes(), std::memory_order_relaxed);
+        conn.backoff = duration::zero();
+    }
+    
+    const BenchConfig& config_;
+    AsyncIO& io_;
+    std::vector<Connection> conns_;
+    std::vector<char> buffer_;
+    BenchResult result_;
+};
 
 } // anonymous namespace
 
@@ -68,6 +406,13 @@ int bench(std::span<const char*> args) {
     parser.add_positional("duration", "Duration (e.g., 10s)");
     parser.add_option("connections", "c", "Number of concurrent connections", "10");
     parser.add_option("port", "p", "Port number", "80");
+    parser.add_option("pipeline", "P", "Requests in flight per connection", "1");
+    parser.add_option("rate", "R", "Open-loop mode: total requests/sec on a fixed schedule");
+    parser.add_option("precision", "", "Latency histogram significant digits (1-5)", "2");
+    parser.add_option("cores", "", "Reactor threads, one per core (default: all cores)");
+    parser.add_option("threads", "T", "Same as --cores");
+    parser.add_option("io-backend", "", "Event loop backend: epoll, io_uring or auto", "auto");
+    parser.add_flag("no-pin", "", "Do not pin reactor threads to CPUs");
     parser.add_flag("json", "j", "Output in JSON format");
     
     auto parse_result = parser.parse(args);
@@ -86,6 +431,24 @@ int bench(std::span<const char*> args) {
     std::string duration_str = positional[1];
     size_t connections = parser.get_as<size_t>("connections").value_or(10);
     uint16_t port = parser.get_as<uint16_t>("port").value_or(80);
+    
+    // -T/--threads is the name the reactor count had before --cores
+    auto cores_given = parser.get_as<size_t>("cores");
+    auto threads_given = parser.get_as<size_t>("threads");
+    if (cores_given && threads_given && *cores_given != *threads_given) {
+        std::cerr << ansi::error("--cores and --threads disagree; give one of them") << "\n";
+        return 1;
+    }
+    size_t cores = cores_given.value_or(threads_given.value_or(Runtime::available_cores()));
+    
+    auto backend = AsyncIO::parse_backend(parser.get("io-backend").value_or("auto"));
+    if (!backend) {
+        std::cerr << ansi::error("I/O backend must be epoll, io_uring or auto") << "\n";
+        return 1;
+    }
+    size_t pipeline = parser.get_as<size_t>("pipeline").value_or(1);
+    std::optional<double> rate = parser.get_as<double>("rate");
+    int precision = parser.get_as<int>("precision").value_or(BucketLayout::DEFAULT_DIGITS);
     bool json = parser.get_flag("json");
     
     // Parse URL
@@ -101,59 +464,164 @@ int bench(std::span<const char*> args) {
     // Parse duration
     size_t duration_sec = std::stoi(duration_str.substr(0, duration_str.length() - 1));
     
-    if (!json) {
-        std::cout << ansi::info(std::format(
-            "Benchmarking http://{}:{}{} for {}s with {} connections...\n",
-            host, port, path, duration_sec, connections));
+    if (connections == 0) {
+        std::cerr << ansi::error("At least one connection is required") << "\n";
+        return 1;
     }
+    if (pipeline == 0) {
+        std::cerr << ansi::error("Pipeline depth must be at least 1") << "\n";
+        return 1;
+    }
+    if (precision < 1 || precision > 5) {
+        std::cerr << ansi::error("Precision must be between 1 and 5 digits") << "\n";
+        return 1;
+    }
+    if (rate && *rate <= 0.0) {
+        std::cerr << ansi::error("Rate must be positive") << "\n";
+        return 1;
+    }
+    cores = std::clamp<size_t>(cores, 1, connections);
     
-    Statistics latency_stats;
-    std::atomic<size_t> total_requests{0};
-    std::atomic<size_t> total_bytes{0};
-    std::atomic<size_t> errors{0};
-    std::atomic<bool> running{true};
+    // Resolve once; every connection reuses the address
+    auto addr_result = Socket::resolve(host, port);
+    if (!addr_result) {
+        std::cerr << ansi::error(std::format("Failed to resolve {}: {}",
+            host, addr_result.error)) << "\n";
+        return 1;
+    }
     
-    std::vector<std::thread> threads;
+    BenchConfig config;
+    config.addr = *addr_result;
+    config.pipeline = pipeline;
+    config.connections = connections;
+    config.precision = precision;
+    if (rate) {
+        config.open_loop = true;
+        config.interval = std::chrono::duration_cast<duration>(
+            std::chrono::duration<double>(connections / *rate));
+    }
+    config.request = std::format(
+        "GET {} HTTP/1.1\r\n"
+        "Host: {}\r\n"
+        "Connection: keep-alive\r\n"
+        "User-Agent: NetProbe/1.0\r\n"
+        "\r\n",
+        path, host);
     
-    auto worker = [&]() {
-        while (running) {
-            auto result = http_request(host, port, path);
-            
-            if (result) {
-                auto [bytes, latency] = *result;
-                latency_stats.add(latency);
-                total_requests.fetch_add(1);
-                total_bytes.fetch_add(bytes);
-            } else {
-                errors.fetch_add(1);
-            }
+    if (!json) {
+        std::cout << ansi::info(std::format(
+            "Benchmarking http://{}:{}{} for {}s with {} connections on {} cores{}...\n",
+            host, port, path, duration_sec, connections, cores,
+            pipeline > 1 ? std::format(", pipeline depth {}", pipeline) : ""));
+        if (rate) {
+            std::cout << ansi::info(std::format(
+                "Open-loop at {:.0f} req/s; latency measured from scheduled send time\n",
+                *rate));
         }
-    };
+    }
     
     auto start_time = steady_clock::now();
+    config.start = start_time;
+    config.deadline = start_time + std::chrono::seconds(duration_sec);
     
-    for (size_t i = 0; i < connections; ++i) {
-        threads.emplace_back(worker);
-    }
+    // Shard connections evenly over the reactors; each worker is built on
+    // its reactor's thread and never touched by another reactor
+    Runtime runtime({.cores = cores, .pin = !parser.get_flag("no-pin"), .backend = *backend});
+    std::vector<std::unique_ptr<BenchWorker>> workers(cores);
     
-    // Wait for duration
-    std::this_thread::sleep_for(std::chrono::seconds(duration_sec));
-    running = false;
+    runtime.start([&](size_t index, AsyncIO& io) {
+        // The kernel may stretch a timed wait by the thread's timer slack,
+        // 50us by default; a scheduled send late by that much would be
+        // charged to the server
+        if (config.open_loop) prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+        
+        auto [first_conn, share] = Runtime::shard(connections, index, cores);
+        workers[index] = std::make_unique<BenchWorker>(config, io, first_conn, share);
+        workers[index]->start();
+    });
+    
+    // Drain the per-reactor recorders into the run totals; called once per
+    // reporting interval while the reactors run and once after they stop
+    Histogram latency_stats(precision);
+    Histogram service_stats(precision);
+    Histogram interval_latency(precision);
+    
+    auto collect = [&]() {
+        interval_latency.reset();
+        for (auto& worker : workers) {
+            worker->result().latency.drain_into(interval_latency);
+            worker->result().service_time.drain_into(service_stats);
+        }
+        latency_stats.merge(interval_latency);
+    };
     
-    for (auto& t : threads) {
-        t.join();
+    auto next_report = start_time + 1s;
+    auto last_report = start_time;
+    while (next_report < config.deadline) {
+        std::this_thread::sleep_until(next_report);
+        collect();
+        
+        if (!json) {
+            auto now = steady_clock::now();
+            double elapsed = std::chrono::duration<double>(now - last_report).count();
+            std::cout << std::format("  [{:>4.0f}s] {:>10.0f} req/s   p50 {:>8.2f} ms   p99 {:>8.2f} ms\n",
+                std::chrono::duration<double>(now - start_time).count(),
+                interval_latency.count() / elapsed,
+                interval_latency.percentile(50),
+                interval_latency.percentile(99));
+            last_report = now;
+        }
+        next_report += 1s;
     }
     
+    runtime.join();
+    collect();
+    
     auto end_time = steady_clock::now();
     auto actual_duration = std::chrono::duration<double>(end_time - start_time).count();
     
+    size_t total_requests = latency_stats.count();
+    size_t total_bytes = 0;
+    size_t errors = 0;
+    
+    for (auto& worker : workers) {
+        total_bytes += worker->result().bytes.load();
+        errors += worker->result().errors.load();
+    }
+    
     double req_per_sec = total_requests / actual_duration;
     double bytes_per_sec = total_bytes / actual_duration;
     double error_rate = total_requests > 0 
         ? (100.0 * errors) / (total_requests + errors)
         : 0.0;
     
+    auto latency_json = [](const Histogram& stats) {
+        return std::format(R"({{
+    "min": {:.2f},
+    "avg": {:.2f},
+    "p50": {:.2f},
+    "p95": {:.2f},
+    "p99": {:.2f},
+    "p999": {:.2f},
+    "max": {:.2f}
+  }})",
+            stats.min(), stats.mean(), stats.percentile(50), stats.percentile(95),
+            stats.percentile(99), stats.percentile(99.9), stats.max());
+    };
+    
     if (json) {
+        // Mergeable form of the latency distribution for fleet-wide rollups
+        QuantileSketch latency_sketch;
+        latency_sketch.add(latency_stats);
+        
+        std::string open_loop_json;
+        if (rate) {
+            open_loop_json = std::format(R"(,
+  "target_rate": {:.2f},
+  "service_time": {})",
+                *rate, latency_json(service_stats));
+        }
+        
         std::cout << std::format(R"({{
   "url": "http://{}:{}{}",
   "duration": {:.2f},
@@ -163,53 +631,58 @@ int bench(std::span<const char*> args) {
   "bytes_per_sec": {:.2f},
   "errors": {},
   "error_rate": {:.2f},
-  "latency": {{
-    "min": {:.2f},
-    "avg": {:.2f},
-    "p50": {:.2f},
-    "p95": {:.2f},
-    "p99": {:.2f},
-    "max": {:.2f}
-  }}
+  "latency": {},
+  "latency_sketch": {}{}
 }})",
             host, port, path,
             actual_duration,
-            total_requests.load(),
+            total_requests,
             req_per_sec,
-            total_bytes.load(),
+            total_bytes,
             bytes_per_sec,
-            errors.load(),
+            errors,
             error_rate,
-            latency_stats.min(),
-            latency_stats.mean(),
-            latency_stats.percentile(50),
-            latency_stats.percentile(95),
-            latency_stats.percentile(99),
-            latency_stats.max());
+            latency_json(latency_stats),
+            latency_sketch.to_json(),
+            open_loop_json);
     } else {
         std::cout << "\n" << ansi::colorize("Benchmark Results", ansi::color::BOLD) << "\n\n";
         
         ansi::Table table(std::vector<std::string>{"Metric", "Value"});
         table.add_row({"Duration", std::format("{:.2f}s", actual_duration)});
-        table.add_row({"Total Requests", std::format("{}", total_requests.load())});
+        table.add_row({"Total Requests", std::format("{}", total_requests)});
         table.add_row({"Requests/sec", ansi::success(std::format("{:.2f}", req_per_sec))});
-        table.add_row({"Total Bytes", std::format("{}", total_bytes.load())});
+        table.add_row({"Total Bytes", std::format("{}", total_bytes)});
         table.add_row({"Throughput", std::format("{:.2f} KB/s", bytes_per_sec / 1024)});
-        table.add_row({"Errors", errors > 0 ? ansi::error(std::format("{}", errors.load())) 
-                                            : std::format("{}", errors.load())});
+        table.add_row({"Errors", errors > 0 ? ansi::error(std::format("{}", errors)) 
+                                            : std::format("{}", errors)});
         table.add_row({"Error Rate", std::format("{:.2f}%", error_rate)});
         
         std::cout << table.render() << "\n";
         
-        std::cout << ansi::colorize("Latency Distribution", ansi::color::BOLD) << "\n\n";
+        std::cout << ansi::colorize(rate 
+            ? "Latency Distribution (corrected for coordinated omission)" 
+            : "Latency Distribution", ansi::color::BOLD) << "\n\n";
+        
+        // Open-loop runs also show the uncorrected service time, so the
+        // gap between the two columns is the queueing the server caused
+        std::vector<std::string> headers{"Percentile", "Latency (ms)"};
+        if (rate) headers.push_back("Service (ms)");
+        ansi::Table latency_table(headers);
         
-        ansi::Table latency_table({"Percentile", "Latency (ms)"});
-        latency_table.add_row({"Min", std::format("{:.2f}", latency_stats.min())});
-        latency_table.add_row({"P50", std::format("{:.2f}", latency_stats.percentile(50))});
-        latency_table.add_row({"P95", std::format("{:.2f}", latency_stats.percentile(95))});
-        latency_table.add_row({"P99", std::format("{:.2f}", latency_stats.percentile(99))});
-        latency_table.add_row({"Max", std::format("{:.2f}", latency_stats.max())});
-        latency_table.add_row({"Avg", std::format("{:.2f}", latency_stats.mean())});
+        auto add_row = [&](std::string name, auto stat) {
+            std::vector<std::string> row{std::move(name), 
+                std::format("{:.2f}", stat(latency_stats))};
+            if (rate) row.push_back(std::format("{:.2f}", stat(service_stats)));
+            latency_table.add_row(std::move(row));
+        };
+        add_row("Min", [](const Histogram& s) { return s.min(); });
+        add_row("P50", [](const Histogram& s) { return s.percentile(50); });
+        add_row("P95", [](const Histogram& s) { return s.percentile(95); });
+        add_row("P99", [](const Histogram& s) { return s.percentile(99); });
+        add_row("P99.9", [](const Histogram& s) { return s.percentile(99.9); });
+        add_row("Max", [](const Histogram& s) { return s.max(); });
+        add_row("Avg", [](const Histogram& s) { return s.mean(); });
         
         std::cout << latency_table.render();
     }
@@ -3,103 +3,372 @@
 #include "../stats.h"
 #include "../ansi.h"
 #include "../argparse.h"
+#include "../packet.h"
+#include "../async_io.h"
+#include "../targets.h"
+#include "../timestamps.h"
+#include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
 #include <iostream>
+#include <array>
+#include <cstring>
 #include <format>
-#include <thread>
+#include <functional>
+#include <vector>
 
 namespace netprobe::commands {
 
 namespace {
 
+// Echo sequence numbers index the probes in flight, so at most this many
+// can await a reply at once
+constexpr size_t SEQUENCE_SPACE = 65536;
+
+// How often the progress of a multi-host ping is redrawn
+constexpr auto PROGRESS_INTERVAL = 100ms;
+
+// A flood ping sends at least this often, replies or not
+constexpr auto FLOOD_INTERVAL = 10ms;
+
 struct ICMPPacket {
     icmphdr header;
     char data[56];
 };
 
-uint16_t checksum(const void* data, size_t len) {
-    const uint16_t* buf = static_cast<const uint16_t*>(data);
-    uint32_t sum = 0;
-    
-    while (len > 1) {
-        sum += *buf++;
-        len -= 2;
+// TTL of a reply from its IP_TTL control message; 0 if there is none
+int received_ttl(const msghdr& msg) {
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(const_cast<msghdr*>(&msg)); cmsg;
+         cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&msg), cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TTL) {
+            int ttl = 0;
+            std::memcpy(&ttl, CMSG_DATA(cmsg), sizeof(ttl));
+            return ttl;
+        }
     }
+    return 0;
+}
+
+// One target and what it has answered
+struct Host {
+    std::string name;
+    sockaddr_in addr;
+    Statistics stats;
+    QuantileSketch sketch;      // The same RTTs, mergeable across runs
+    size_t transmitted = 0;
+    size_t received = 0;
+    size_t duplicates = 0;
+    size_t late = 0;            // Answered after timing out
+};
+
+struct PingConfig {
+    size_t count = 10;          // Probes per host
+    duration interval = 1s;     // Between rounds; zero floods
+    duration timeout = 1s;
+};
+
+// Echo requests to any number of hosts over one ICMP socket, driven by an
+// event loop.
+//
+// Probes go out on a fixed schedule: round r starts r intervals after the
+// first, and its probes are spread evenly over the interval so thousands
+// of hosts do not leave in one burst. Send times come from the schedule,
+// not from the previous send, so they never drift; an interval under the
+// timer resolution is kept by sending whatever has come due on each tick.
+// Nothing waits for a reply, so a slow or lost one never delays the next
+// send. With a zero interval the pinger floods instead: a new probe goes
+// out as soon as one is answered, with one per host in flight, and at
+// least every FLOOD_INTERVAL.
+//
+// Replies are read whenever the socket is readable and matched by echo
+// sequence number, which indexes a ring of the probes in flight; the echo
+// id marks them as ours. A probe's slot remembers how it ended until its
+// sequence number comes round again, so a second reply is reported as a
+// duplicate and one after the timeout as late.
+//
+// Round trips come from kernel timestamps where the socket supports them:
+// the send stamp, read off the error queue, and the receive stamp that
+// arrives with the reply. Both are taken at the driver boundary (or by
+// the NIC), so scheduling delays in this process do not count. A probe
+// whose send stamp has not arrived is timed in userspace instead.
+//
+// On a datagram ping socket the kernel replaces the echo id with one of
+// its own and delivers only the replies to it, without their IP header;
+// the TTL then comes as a control message.
+class Pinger {
+public:
+    // Each probe ends in exactly one of on_reply and on_timeout
+    std::function<void(const Host&, size_t round)> on_send;
+    std::function<void(const Host&, size_t round, double rtt, int ttl, bool duplicate)> on_reply;
+    std::function<void(const Host&, size_t round)> on_timeout;
     
-    if (len == 1) {
-        sum += *reinterpret_cast<const uint8_t*>(buf);
+    Pinger(AsyncIO& io, Socket& sock, std::vector<Host>& hosts, const PingConfig& config)
+        : io_(io), sock_(sock), hosts_(hosts), config_(config),
+          total_(hosts.size() * config.count), id_(htons(getpid() & 0xFFFF)),
+          slots_(SEQUENCE_SPACE) {}
+    
+    ~Pinger() {
+        io_.cancel(timer_);
+        io_.remove(sock_.fd());
     }
     
-    sum = (sum >> 16) + (sum & 0xFFFF);
-    sum += (sum >> 16);
+    Pinger(const Pinger&) = delete;
+    Pinger& operator=(const Pinger&) = delete;
     
-    return ~sum;
-}
-
-Result<double> send_ping(Socket& sock, const sockaddr_in& addr, uint16_t seq) {
-    ICMPPacket packet{};
-    packet.header.type = ICMP_ECHO;
-    packet.header.code = 0;
-    packet.header.un.echo.id = htons(getpid() & 0xFFFF);
-    packet.header.un.echo.sequence = htons(seq);
-    
-    // Fill data with pattern
-    for (size_t i = 0; i < sizeof(packet.data); ++i) {
-        packet.data[i] = i;
+    void start() {
+        stamps_ = enable_timestamps(sock_.fd());
+        raw_ = sock_.is_raw();
+        if (!raw_) {
+            int on = 1;
+            setsockopt(sock_.fd(), IPPROTO_IP, IP_RECVTTL, &on, sizeof(on));
+        }
+        start_ = steady_clock::now();
+        io_.add(sock_.fd(), AsyncIO::Event::READ, [this](int, AsyncIO::Event) { on_readable(); });
+        timer_ = io_.schedule(duration::zero(), [this] { pump(); });
     }
     
-    packet.header.checksum = 0;
-    packet.header.checksum = checksum(&packet, sizeof(packet));
+    bool done() const { return completed_ == total_; }
     
-    auto start = steady_clock::now();
+    // Probes answered or timed out
+    uint64_t completed() const { return completed_; }
+    uint64_t total() const { return total_; }
     
-    auto result = sock.sendto(&packet, sizeof(packet),
-        reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    // Where most round trips were measured
+    TimestampSource rtt_source() const {
+        size_t best = sources_.size() - 1;
+        for (size_t i = 0; i < sources_.size(); ++i) {
+            if (sources_[i] > sources_[best]) best = i;
+        }
+        return static_cast<TimestampSource>(best);
+    }
+
+private:
+    enum : uint8_t {
+        UNUSED,
+        WAITING,
+        ANSWERED,
+        EXPIRED
+    };
     
-    if (!result) {
-        return Result<double>(result.error);
+    struct Slot {
+        time_point sent;
+        KernelTimestamp sent_stamp;
+        uint32_t host;
+        uint32_t round;
+        uint8_t state = UNUSED;
+    };
+    
+    // Probe k goes to host k % hosts in round k / hosts
+    time_point due(uint64_t k) const {
+        uint64_t round = k / hosts_.size();
+        uint64_t host = k % hosts_.size();
+        return start_ + config_.interval * round +
+               config_.interval * host / hosts_.size();
     }
     
-    // Wait for reply (with IP header on Linux)
-    uint8_t buffer[1024];
-    sockaddr_in from{};
-    socklen_t fromlen = sizeof(from);
+    static uint16_t sequence(uint64_t k) { return static_cast<uint16_t>(k + 1); }
+    Slot& slot(uint64_t k) { return slots_[sequence(k)]; }
     
-    auto recv_result = sock.recvfrom(buffer, sizeof(buffer),
-        reinterpret_cast<sockaddr*>(&from), &fromlen);
+    bool flood() const { return config_.interval == duration::zero(); }
     
-    if (!recv_result) {
-        return Result<double>(recv_result.error);
+    // Whether probe `next_` may go out now
+    bool ready(time_point now) const {
+        if (!flood()) return due(next_) <= now;
+        return in_flight_ < hosts_.size() || now - last_sent_ >= FLOOD_INTERVAL;
     }
     
-    auto end = steady_clock::now();
-    auto rtt = std::chrono::duration<double, std::milli>(end - start).count();
-    
-    // Skip IP header (first 20 bytes typically)
-    size_t ip_hdr_len = (buffer[0] & 0x0F) * 4;
-    if (*recv_result < ip_hdr_len + sizeof(icmphdr)) {
-        return Result<double>("Packet too small");
+    void pump() {
+        timer_ = TimerWheel::INVALID_TIMER;
+        auto now = steady_clock::now();
+        
+        // Probes are retired in the order they were sent
+        while (base_ < next_) {
+            Slot& slot = this->slot(base_);
+            if (slot.state == WAITING) {
+                if (now < slot.sent + config_.timeout) break;
+                slot.state = EXPIRED;
+                --in_flight_;
+                ++completed_;
+                if (on_timeout) on_timeout(hosts_[slot.host], slot.round);
+            }
+            ++base_;
+        }
+        
+        // Everything that has come due, as long as sequence numbers last
+        while (next_ < total_ && next_ - base_ < slots_.size() && ready(now)) {
+            if (!send(next_)) break;
+            ++next_;
+        }
+        
+        if (done()) return;
+        
+        time_point wake = time_point::max();
+        if (next_ < total_ && next_ - base_ < slots_.size()) {
+            wake = flood() ? last_sent_ + FLOOD_INTERVAL : due(next_);
+        }
+        if (base_ < next_) {
+            wake = std::min(wake, slot(base_).sent + config_.timeout);
+        }
+        timer_ = io_.schedule_at(wake, [this] { pump(); });
     }
     
-    const icmphdr* reply = reinterpret_cast<const icmphdr*>(buffer + ip_hdr_len);
+    // False if the socket buffer is full and the probe should be sent later
+    bool send(uint64_t k) {
+        uint32_t index = static_cast<uint32_t>(k % hosts_.size());
+        Host& host = hosts_[index];
+        
+        ICMPPacket packet{};
+        packet.header.type = ICMP_ECHO;
+        packet.header.code = 0;
+        packet.header.un.echo.id = id_;
+        packet.header.un.echo.sequence = htons(sequence(k));
+        
+        // Fill data with pattern
+        for (size_t i = 0; i < sizeof(packet.data); ++i) {
+            packet.data[i] = static_cast<char>(i);
+        }
+        packet.header.checksum = checksum(&packet, sizeof(packet));
+        
+        auto sent = steady_clock::now();
+        ssize_t n = ::sendto(sock_.fd(), &packet, sizeof(packet), MSG_DONTWAIT,
+                             reinterpret_cast<const sockaddr*>(&host.addr), sizeof(host.addr));
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+            return false;
+        }
+        
+        // The kernel numbers the sends it stamps
+        if (n >= 0 && stamps_) {
+            stamp_keys_[stamp_count_++ % stamp_keys_.size()] = sequence(k);
+        }
+        
+        // Any other error (no route, say) leaves the probe to time out
+        uint32_t round = static_cast<uint32_t>(k / hosts_.size());
+        slot(k) = {sent, {}, index, round, WAITING};
+        last_sent_ = sent;
+        ++in_flight_;
+        ++host.transmitted;
+        if (on_send) on_send(host, round);
+        return true;
+    }
     
-    // Verify it's our packet
-    if (reply->type != ICMP_ECHOREPLY || 
-        reply->un.echo.id != htons(getpid() & 0xFFFF) ||
-        reply->un.echo.sequence != htons(seq)) {
-        return Result<double>("Invalid ICMP reply");
+    void on_readable() {
+        // Send stamps first, so replies that follow find them
+        while (stamps_) {
+            auto tx = read_tx_timestamp(sock_.fd());
+            if (!tx) break;
+            
+            Slot& slot = slots_[stamp_keys_[tx->key % stamp_keys_.size()]];
+            if (slot.state != WAITING) continue;
+            if (tx->stamp.software_ns) slot.sent_stamp.software_ns = tx->stamp.software_ns;
+            if (tx->stamp.hardware_ns) slot.sent_stamp.hardware_ns = tx->stamp.hardware_ns;
+        }
+        
+        uint8_t buffer[1024];
+        alignas(cmsghdr) char control[TIMESTAMP_CONTROL_SIZE];
+        
+        while (true) {
+            sockaddr_in from{};
+            iovec iov{buffer, sizeof(buffer)};
+            msghdr msg{};
+            msg.msg_name = &from;
+            msg.msg_namelen = sizeof(from);
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            ssize_t n = ::recvmsg(sock_.fd(), &msg, MSG_DONTWAIT);
+            if (n < 0) break;
+            auto now = steady_clock::now();
+            
+            // Raw ICMP sockets deliver the IP header too
+            size_t ip_hdr_len = raw_ ? (buffer[0] & 0x0F) * 4 : 0;
+            if (static_cast<size_t>(n) < ip_hdr_len + sizeof(icmphdr)) continue;
+            
+            // Our own requests are delivered as well when pinging a local
+            // address; only replies count
+            const icmphdr* reply = reinterpret_cast<const icmphdr*>(buffer + ip_hdr_len);
+            if (reply->type != ICMP_ECHOREPLY) continue;
+            if (raw_ && reply->un.echo.id != id_) continue;
+            
+            Slot& slot = slots_[ntohs(reply->un.echo.sequence)];
+            if (slot.state == UNUSED) continue;
+            Host& host = hosts_[slot.host];
+            if (host.addr.sin_addr.s_addr != from.sin_addr.s_addr) continue;
+            
+            double rtt = std::chrono::duration<double, std::milli>(now - slot.sent).count();
+            auto source = TimestampSource::USERSPACE;
+            if (auto kernel = kernel_rtt(slot.sent_stamp, message_timestamp(msg))) {
+                rtt = kernel->ms;
+                source = kernel->source;
+            }
+            
+            int ttl = raw_ ? reinterpret_cast<const iphdr*>(buffer)->ttl : received_ttl(msg);
+            switch (slot.state) {
+                case WAITING:
+                    slot.state = ANSWERED;
+                    --in_flight_;
+                    ++completed_;
+                    ++sources_[static_cast<size_t>(source)];
+                    ++host.received;
+                    host.stats.add(rtt);
+                    host.sketch.add(rtt);
+                    if (on_reply) on_reply(host, slot.round, rtt, ttl, false);
+                    break;
+                case ANSWERED:
+                    ++host.duplicates;
+                    if (on_reply) on_reply(host, slot.round, rtt, ttl, true);
+                    break;
+                case EXPIRED:
+                    ++host.late;
+                    break;
+            }
+        }
+        
+        // A flood sends the next probe as soon as a reply frees its place
+        if (flood() && !done()) {
+            io_.cancel(timer_);
+            pump();
+        }
     }
     
-    return rtt;
+    AsyncIO& io_;
+    Socket& sock_;
+    std::vector<Host>& hosts_;
+    const PingConfig& config_;
+    uint64_t total_;
+    uint16_t id_;
+    
+    std::vector<Slot> slots_;   // By echo sequence number
+    uint64_t base_ = 0;         // Oldest probe not yet retired
+    uint64_t next_ = 0;         // Next probe to send
+    uint64_t completed_ = 0;
+    size_t in_flight_ = 0;
+    
+    // Send stamps: the sequence number of each stamped send, by its key
+    bool raw_ = true;
+    bool stamps_ = false;
+    std::array<uint16_t, SEQUENCE_SPACE> stamp_keys_{};
+    uint32_t stamp_count_ = 0;
+    std::array<uint64_t, 3> sources_{};
+    
+    time_point start_{};
+    time_point last_sent_{};
+    AsyncIO::TimerId timer_ = TimerWheel::INVALID_TIMER;
+};
+
+std::string ip_string(const sockaddr_in& addr) {
+    char buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, buf, sizeof(buf));
+    return buf;
 }
 
 } // anonymous namespace
 
 int ping(std::span<const char*> args) {
-    ArgParser parser("Send ICMP echo requests to a host");
-    parser.add_positional("host", "Target host");
-    parser.add_option("count", "c", "Number of pings", "10");
-    parser.add_option("interval", "i", "Interval between pings (ms)", "1000");
+    ArgParser parser("Send ICMP echo requests to one or more hosts");
+    parser.add_positional("host", "Target host, address or CIDR block; several may be given", false);
+    parser.add_option("file", "f", "Read hosts from a file, one per line");
+    parser.add_option("count", "c", "Number of pings per host", "10");
+    parser.add_option("interval", "i", "Interval between pings (ms, fractions allowed; 0 floods)", "1000");
     parser.add_option("timeout", "t", "Timeout for each ping (ms)", "1000");
     parser.add_flag("json", "j", "Output in JSON format");
     
@@ -109,103 +378,222 @@ int ping(std::span<const char*> args) {
         return 1;
     }
     
+    auto file = parser.get("file");
     auto positional = parser.get_positional();
-    if (positional.empty()) {
+    if (positional.empty() && !file) {
         std::cerr << ansi::error("Missing host argument") << "\n";
         return 1;
     }
     
-    std::string host = positional[0];
-    size_t count = parser.get_as<size_t>("count").value_or(10);
-    size_t interval = parser.get_as<size_t>("interval").value_or(1000);
-    size_t timeout = parser.get_as<size_t>("timeout").value_or(1000);
+    PingConfig config;
+    config.count = parser.get_as<size_t>("count").value_or(10);
+    double interval = parser.get_as<double>("interval").value_or(1000);
+    config.timeout = std::chrono::milliseconds(parser.get_as<size_t>("timeout").value_or(1000));
     bool json = parser.get_flag("json");
     
-    // Resolve host
-    auto addr_result = Socket::resolve(host, 0);
-    if (!addr_result) {
-        std::cerr << ansi::error(std::format("Failed to resolve {}: {}", 
-            host, addr_result.error)) << "\n";
+    if (config.count == 0) {
+        std::cerr << ansi::error("Count must be at least 1") << "\n";
+        return 1;
+    }
+    if (!(interval >= 0)) {
+        std::cerr << ansi::error("Interval must not be negative") << "\n";
+        return 1;
+    }
+    config.interval = std::chrono::duration_cast<duration>(
+        std::chrono::duration<double, std::milli>(interval));
+    bool flood = config.interval == duration::zero();
+    
+    // Resolve hosts
+    TargetSet targets;
+    if (file) {
+        auto res = targets.add_file(*file);
+        if (!res) {
+            std::cerr << ansi::error(res.error) << "\n";
+            return 1;
+        }
+    }
+    for (const auto& spec : positional) {
+        auto res = targets.add(spec);
+        if (!res) {
+            std::cerr << ansi::error(std::format("Failed to resolve {}", res.error)) << "\n";
+            return 1;
+        }
+    }
+    if (targets.empty()) {
+        std::cerr << ansi::error("No hosts to ping") << "\n";
         return 1;
     }
     
-    auto& addr = *addr_result;
+    std::vector<Host> hosts(targets.size());
+    for (size_t i = 0; i < hosts.size(); ++i) {
+        hosts[i].addr.sin_family = AF_INET;
+        hosts[i].addr.sin_addr.s_addr = targets.at(i);
+        hosts[i].name = ip_string(hosts[i].addr);
+    }
+    
+    // One host keeps the classic per-reply output; several get a summary
+    bool single = hosts.size() == 1;
+    if (single && !positional.empty()) {
+        hosts[0].name = positional[0];
+    }
     
     // Create ICMP socket
     Socket sock(Socket::Type::ICMP);
     if (!sock.is_valid()) {
-        std::cerr << ansi::error("Failed to create ICMP socket (try running with sudo)") << "\n";
+        std::cerr << ansi::error("Failed to create ICMP socket (run with sudo, or allow ping sockets "
+            "with sysctl net.ipv4.ping_group_range)") << "\n";
         return 1;
     }
     
-    sock.set_timeout(std::chrono::milliseconds(timeout));
-    
-    if (!json) {
-        std::cout << ansi::info(std::format("PING {} ({}) {} bytes of data",
-            host, Socket::addr_to_string(addr).substr(0, Socket::addr_to_string(addr).find(':')),
-            sizeof(ICMPPacket))) << "\n\n";
-    }
+    // Replies from a large sweep arrive in bursts
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(sock.fd(), SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
     
-    Statistics stats;
-    size_t transmitted = 0;
-    size_t received = 0;
+    AsyncIO io;
+    Pinger pinger(io, sock, hosts, config);
     
-    for (size_t i = 0; i < count; ++i) {
-        transmitted++;
-        
-        auto rtt_result = send_ping(sock, addr, i + 1);
+    if (single) {
+        if (!json) {
+            std::cout << ansi::info(std::format("PING {} ({}) {} bytes of data",
+                hosts[0].name, ip_string(hosts[0].addr), sizeof(ICMPPacket))) << "\n\n";
+        }
         
-        if (rtt_result) {
-            received++;
-            double rtt = *rtt_result;
-            stats.add(rtt);
-            
-            if (!json) {
+        pinger.on_reply = [&](const Host& host, size_t round, double rtt, int ttl, bool duplicate) {
+            if (!json && !flood) {
                 std::cout << ansi::success(std::format(
-                    "64 bytes from {}: icmp_seq={} ttl=64 time={:.2f} ms",
-                    Socket::addr_to_string(addr).substr(0, Socket::addr_to_string(addr).find(':')),
-                    i + 1, rtt)) << "\n";
+                    "64 bytes from {}: icmp_seq={} ttl={} time={:.2f} ms{}",
+                    ip_string(host.addr), round + 1, ttl, rtt, duplicate ? " (DUP!)" : "")) << "\n";
             }
-        } else {
-            if (!json) {
+        };
+        pinger.on_timeout = [&](const Host&, size_t round) {
+            if (!json && !flood) {
                 std::cout << ansi::error(std::format(
-                    "Request timeout for icmp_seq {}", i + 1)) << "\n";
+                    "Request timeout for icmp_seq {}", round + 1)) << "\n";
             }
-        }
+        };
         
-        if (i < count - 1) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        // A flood prints a dot per request and erases one per reply, so
+        // the dots left standing are the losses
+        if (!json && flood) {
+            pinger.on_send = [](const Host&, size_t) { std::cout << '.' << std::flush; };
+            auto on_reply = pinger.on_reply;
+            pinger.on_reply = [on_reply](const Host& host, size_t round, double rtt, int ttl, bool duplicate) {
+                on_reply(host, round, rtt, ttl, duplicate);
+                if (!duplicate) std::cout << '\b' << std::flush;
+            };
         }
+    } else if (!json) {
+        std::cout << ansi::info(std::format("PING {} hosts, {} each, {} bytes of data",
+            hosts.size(), config.count, sizeof(ICMPPacket))) << "\n";
     }
     
-    double loss = transmitted > 0 
-        ? 100.0 * (transmitted - received) / transmitted 
-        : 0.0;
+    ansi::ProgressBar progress(pinger.total());
+    bool show_progress = !single && !json;
+    auto last_progress = steady_clock::now();
     
-    if (json) {
-        std::cout << std::format(R"({{
+    auto started = steady_clock::now();
+    pinger.start();
+    while (!pinger.done()) {
+        io.run_once(PROGRESS_INTERVAL);
+        if (show_progress && steady_clock::now() - last_progress >= PROGRESS_INTERVAL) {
+            progress.update(pinger.completed());
+            last_progress = steady_clock::now();
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(steady_clock::now() - started).count();
+    if (show_progress) {
+        progress.finish();
+    }
+    const char* rtt_source = timestamp_source_name(pinger.rtt_source());
+    
+    auto loss_of = [](const Host& host) {
+        return host.transmitted > 0
+            ? 100.0 * (host.transmitted - host.received) / host.transmitted
+            : 0.0;
+    };
+    
+    if (single) {
+        const Host& host = hosts[0];
+        const Statistics& stats = host.stats;
+        double loss = loss_of(host);
+        
+        if (json) {
+            std::cout << std::format(R"({{
   "host": "{}",
   "transmitted": {},
   "received": {},
+  "duplicates": {},
+  "late": {},
   "loss_percent": {:.2f},
+  "elapsed_ms": {:.0f},
+  "rtt_source": "{}",
   "rtt_min": {:.2f},
   "rtt_avg": {:.2f},
   "rtt_max": {:.2f},
   "rtt_stddev": {:.2f},
-  "jitter": {:.2f}
+  "jitter": {:.2f},
+  "rtt_sketch": {}
 }})",
-            host, transmitted, received, loss,
-            stats.min(), stats.mean(), stats.max(),
-            stats.stddev(), stats.jitter());
+                host.name, host.transmitted, host.received, host.duplicates, host.late,
+                loss, elapsed, rtt_source, stats.min(), stats.mean(), stats.max(),
+                stats.stddev(), stats.jitter(), host.sketch.to_json());
+        } else {
+            std::string extra;
+            if (host.duplicates > 0) extra += std::format(", +{} duplicates", host.duplicates);
+            if (host.late > 0) extra += std::format(", {} late", host.late);
+            
+            std::cout << "\n" << ansi::colorize("--- ping statistics ---", ansi::color::BOLD) << "\n";
+            std::cout << std::format("{} packets transmitted, {} received{}, {:.1f}% packet loss, time {:.0f}ms\n",
+                host.transmitted, host.received, extra, loss, elapsed);
+            
+            if (host.received > 0) {
+                std::cout << std::format("rtt min/avg/max/stddev = {:.2f}/{:.2f}/{:.2f}/{:.2f} ms\n",
+                    stats.min(), stats.mean(), stats.max(), stats.stddev());
+                std::cout << std::format("jitter = {:.2f} ms\n", stats.jitter());
+                std::cout << std::format("rtt source: {} timestamps\n", rtt_source);
+            }
+        }
+        return 0;
+    }
+    
+    size_t alive = 0;
+    for (const auto& host : hosts) {
+        if (host.received > 0) ++alive;
+    }
+    
+    if (json) {
+        std::cout << "{\n  \"hosts\": [\n";
+        for (size_t i = 0; i < hosts.size(); ++i) {
+            const Host& host = hosts[i];
+            std::cout << std::format("    {{\"host\": \"{}\", \"transmitted\": {}, \"received\": {}, "
+                "\"duplicates\": {}, \"late\": {}, "
+                "\"loss_percent\": {:.2f}, \"rtt_min\": {:.2f}, \"rtt_avg\": {:.2f}, \"rtt_max\": {:.2f}, "
+                "\"rtt_sketch\": {}}}",
+                host.name, host.transmitted, host.received, host.duplicates, host.late, loss_of(host),
+                host.stats.min(), host.stats.mean(), host.stats.max(), host.sketch.to_json());
+            if (i < hosts.size() - 1) std::cout << ",";
+            std::cout << "\n";
+        }
+        std::cout << std::format("  ],\n  \"alive\": {},\n  \"rtt_source\": \"{}\"\n}}\n",
+            alive, rtt_source);
     } else {
-        std::cout << "\n" << ansi::colorize("--- ping statistics ---", ansi::color::BOLD) << "\n";
-        std::cout << std::format("{} packets transmitted, {} received, {:.1f}% packet loss\n",
-            transmitted, received, loss);
-        
-        if (received > 0) {
-            std::cout << std::format("rtt min/avg/max/stddev = {:.2f}/{:.2f}/{:.2f}/{:.2f} ms\n",
-                stats.min(), stats.mean(), stats.max(), stats.stddev());
-            std::cout << std::format("jitter = {:.2f} ms\n", stats.jitter());
+        ansi::Table table({"Host", "Sent", "Received", "Loss", "Min", "Avg", "Max"});
+        for (const auto& host : hosts) {
+            bool answered = host.received > 0;
+            table.add_row({
+                host.name,
+                std::format("{}", host.transmitted),
+                std::format("{}", host.received),
+                std::format("{:.1f}%", loss_of(host)),
+                answered ? std::format("{:.2f}", host.stats.min()) : "-",
+                answered ? std::format("{:.2f}", host.stats.mean()) : "-",
+                answered ? std::format("{:.2f}", host.stats.max()) : "-"
+            });
+        }
+        std::cout << "\n" << table.render();
+        std::cout << "\n" << ansi::success(std::format("{} of {} hosts answered", alive, hosts.size())) << "\n";
+        if (alive > 0) {
+            std::cout << std::format("rtt source: {} timestamps\n", rtt_source);
         }
     }
     
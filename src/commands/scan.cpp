@@ -3,54 +3,1070 @@
 #include "../ansi.h"
 #include "../argparse.h"
 #include "../async_io.h"
+#include "../coro.h"
+#include "../runtime.h"
+#include "../packet.h"
+#include "../targets.h"
+#include "../congestion.h"
+#include "../services.h"
+#include "../checkpoint.h"
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <charconv>
+#include <cstring>
+#include <random>
 #include <iostream>
 #include <format>
 #include <vector>
+#include <algorithm>
 #include <atomic>
-#include <thread>
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace netprobe::commands {
 
 namespace {
 
+constexpr size_t DEFAULT_CONCURRENCY = 4096;
+
+// fds kept back from the in-flight budget for stdio, epoll and eventfds
+constexpr size_t RESERVED_FDS = 64;
+
+// Back-off when the process runs out of fds or local ports
+constexpr auto RETRY_DELAY = 10ms;
+
+// Shortest wait for a reply, however fast a target has answered before
+constexpr auto MIN_TIMEOUT = 100ms;
+
+// How often parked connect workers are offered the window again
+constexpr auto ADMIT_INTERVAL = 1ms;
+
+// Most SYN or UDP probes sent per loop iteration, so replies are drained
+// between bursts
+constexpr size_t SEND_BURST = 256;
+
+// UDP datagrams handed to one sendmmsg()
+constexpr size_t SEND_BATCH = 64;
+
+// Most SYN or UDP probes awaiting a reply at once: 262144 ring slots,
+// 8MB per reactor, however many targets the scan covers
+constexpr size_t MAX_RING_SIZE = size_t{1} << 18;
+
+// Replies read per recvmmsg(), and the bytes kept of each; the headers
+// are all the receive path looks at
+constexpr size_t REPLY_BATCH = 64;
+constexpr size_t REPLY_SNAP = 128;
+
+// Bytes of a service's banner kept for fingerprinting
+constexpr size_t BANNER_SIZE = 512;
+
+// How often a resumable scan's progress is written back to disk
+constexpr auto CHECKPOINT_INTERVAL = 1s;
+
+// How long an open port gets to greet, and again to answer the probe
+// sent if it does not; then how long to wait for the rest of a reply
+// that arrives in pieces
+constexpr auto BANNER_WAIT = 1s;
+constexpr auto BANNER_FOLLOWUP = 100ms;
+
+enum class PortState {
+    OPEN,
+    CLOSED,
+    FILTERED
+};
+
 struct ScanResult {
+    in_addr_t host;
     uint16_t port;
-    bool open;
+    PortState state;
     std::string service;
+    std::string version;
 };
 
-std::string get_service_name(uint16_t port) {
-    static const std::map<uint16_t, std::string> services = {
-        {20, "ftp-data"}, {21, "ftp"}, {22, "ssh"}, {23, "telnet"},
-        {25, "smtp"}, {53, "dns"}, {80, "http"}, {110, "pop3"},
-        {143, "imap"}, {443, "https"}, {465, "smtps"}, {587, "smtp"},
-        {993, "imaps"}, {995, "pop3s"}, {3306, "mysql"}, {5432, "postgresql"},
-        {6379, "redis"}, {27017, "mongodb"}, {8080, "http-alt"}, {8443, "https-alt"}
+// Shared, read-only run parameters
+struct ScanConfig {
+    std::chrono::milliseconds timeout{500};     // Longest wait for a reply
+    size_t concurrency = DEFAULT_CONCURRENCY;   // Per reactor
+    
+    // Per reactor, in probes/sec; 0: no bound
+    double min_rate = 0;
+    double max_rate = 0;
+    
+    // Connect scan: read what open ports send before closing them
+    bool banners = false;
+    
+    // Where each probe's outcome is saved, if the scan can be resumed
+    Checkpoint* checkpoint = nullptr;
+    
+    // SYN scan: replies come back to `source_port` on `source`, and carry
+    // a sequence number derived from `secret`
+    in_addr_t source = 0;
+    uint16_t source_port = 0;
+    uint32_t secret = 0;
+};
+
+// One address (network byte order) and port to probe
+struct Probe {
+    in_addr_t addr;
+    uint16_t port;
+    uint64_t index;     // In the scan plan
+};
+
+// Every target crossed with every port, as one index space visited in a
+// scattered order. Neither the pairs nor their order are stored: probe i
+// is computed from the permutation, so memory does not grow with the
+// number of targets. Consecutive probes land on different hosts.
+class ScanPlan {
+public:
+    ScanPlan(const TargetSet& targets, std::vector<uint16_t> ports, uint64_t seed)
+        : targets_(targets), ports_(std::move(ports)),
+          order_(targets_.size() * ports_.size(), seed) {}
+    
+    uint64_t size() const { return order_.size(); }
+    size_t port_count() const { return ports_.size(); }
+    
+    Probe probe(uint64_t index) const {
+        uint64_t pos = order_.map(index);
+        return {targets_.at(pos % targets_.size()), ports_[pos / targets_.size()], index};
+    }
+
+private:
+    const TargetSet& targets_;
+    std::vector<uint16_t> ports_;
+    Permutation order_;
+};
+
+std::string ip_string(in_addr_t addr) {
+    char buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr, buf, sizeof(buf));
+    return buf;
+}
+
+// Names a scan's probes, whatever their order, so a checkpoint is only
+// resumed by the same scan
+uint64_t plan_digest(const TargetSet& targets, const std::vector<uint16_t>& ports, Protocol protocol) {
+    uint64_t hash = 0xcbf29ce484222325ull ^ targets.digest();
+    auto add = [&hash](uint64_t value) {
+        hash ^= value;
+        hash *= 0x100000001b3ull;
+    };
+    add(static_cast<uint64_t>(protocol));
+    for (uint16_t port : ports) add(port);
+    return hash;
+}
+
+// Banner text may hold quotes and backslashes
+std::string json_escape(std::string_view text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// "22", "1-1024", "22,80,8000-8100"; sorted, without duplicates
+Result<std::vector<uint16_t>> parse_ports(std::string_view spec) {
+    std::vector<uint16_t> ports;
+    
+    auto parse_port = [](std::string_view text, int& port) {
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), port);
+        return ec == std::errc() && ptr == text.data() + text.size() && port >= 1 && port <= 65535;
     };
     
-    auto it = services.find(port);
-    return it != services.end() ? it->second : "unknown";
+    size_t pos = 0;
+    while (pos <= spec.length()) {
+        size_t comma = spec.find(',', pos);
+        if (comma == std::string_view::npos) comma = spec.length();
+        std::string_view item = spec.substr(pos, comma - pos);
+        pos = comma + 1;
+        
+        int first = 0;
+        int last = 0;
+        auto dash = item.find('-');
+        bool valid = dash == std::string_view::npos
+            ? parse_port(item, first) && parse_port(item, last)
+            : parse_port(item.substr(0, dash), first) && parse_port(item.substr(dash + 1), last);
+        
+        if (!valid || first > last) {
+            return Result<std::vector<uint16_t>>(std::format("Invalid port specification: {}", item));
+        }
+        for (int port = first; port <= last; ++port) {
+            ports.push_back(static_cast<uint16_t>(port));
+        }
+    }
+    
+    std::sort(ports.begin(), ports.end());
+    ports.erase(std::unique(ports.begin(), ports.end()), ports.end());
+    return ports;
 }
 
-bool scan_port(std::string_view host, uint16_t port, std::chrono::milliseconds timeout) {
-    Socket sock(Socket::Type::TCP);
+// Raise the soft fd limit towards `wanted`; returns the limit in effect
+size_t raise_fd_limit(size_t wanted) {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return 1024;
+    
+    if (limit.rlim_cur < wanted) {
+        rlimit raised = limit;
+        raised.rlim_cur = std::min<rlim_t>(wanted, limit.rlim_max);
+        if (setrlimit(RLIMIT_NOFILE, &raised) == 0) limit = raised;
+    }
+    return static_cast<size_t>(limit.rlim_cur);
+}
+
+// One reactor's slice of a scan plan: probes first, first + stride, ...
+// Each engine paces itself with its own congestion control and keeps
+// round-trip estimates for the targets it has heard from. A resumed scan
+// skips the probes its checkpoint already has an outcome for, except open
+// ports when `reprobe_open` is set: the checkpoint keeps no banners.
+class ScanEngine {
+public:
+    ScanEngine(const ScanPlan& plan, uint64_t first, uint64_t stride,
+               CongestionControl::Limits limits, Checkpoint* checkpoint, bool reprobe_open = false)
+        : control_(limits), plan_(plan), checkpoint_(checkpoint), reprobe_open_(reprobe_open),
+          first_(first), stride_(stride),
+          count_(first < plan.size() ? (plan.size() - first + stride - 1) / stride : 0) {}
+    virtual ~ScanEngine() = default;
+    
+    virtual void start() = 0;
+    
+    // Safe to call from any thread while the reactor runs
+    uint64_t completed() const { return completed_.load(std::memory_order_relaxed); }
+    double rate() const { return control_.rate(); }
+    double window() const { return control_.window(); }
+    
+    // Open ports found since the last call, so results can be streamed
+    // while the scan runs
+    std::vector<ScanResult> take_open() {
+        std::lock_guard lock(open_mutex_);
+        return std::exchange(open_, {});
+    }
+    
+    // Only read after the reactor has stopped
+    uint64_t closed() const { return closed_; }
+    uint64_t filtered() const { return filtered_; }
+
+protected:
+    uint64_t count() const { return count_; }
+    Probe probe_at(uint64_t local) const { return plan_.probe(first_ + local * stride_); }
+    
+    // Whether probe `local` was completed by an earlier run
+    bool resumed(uint64_t local) const {
+        if (!checkpoint_) return false;
+        Checkpoint::State state = checkpoint_->get(first_ + local * stride_);
+        return state != Checkpoint::State::PENDING &&
+               !(reprobe_open_ && state == Checkpoint::State::OPEN);
+    }
+    
+    // `fingerprint` names what answered on an open port, if anything did
+    void record(const Probe& probe, PortState state, Fingerprint fingerprint = {}) {
+        switch (state) {
+            case PortState::OPEN: {
+                std::lock_guard lock(open_mutex_);
+                open_.push_back({probe.addr, probe.port, state,
+                                 std::move(fingerprint.service), std::move(fingerprint.version)});
+                break;
+            }
+            case PortState::CLOSED:
+                ++closed_;
+                break;
+            case PortState::FILTERED:
+                ++filtered_;
+                break;
+        }
+        if (checkpoint_) {
+            checkpoint_->set(probe.index, saved_state(state));
+        }
+        completed_.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    CongestionControl control_;
+    RttTable rtt_;
+
+private:
+    static Checkpoint::State saved_state(PortState state) {
+        switch (state) {
+            case PortState::OPEN: return Checkpoint::State::OPEN;
+            case PortState::CLOSED: return Checkpoint::State::CLOSED;
+            case PortState::FILTERED: break;
+        }
+        return Checkpoint::State::FILTERED;
+    }
+    
+    const ScanPlan& plan_;
+    Checkpoint* checkpoint_;
+    bool reprobe_open_;
+    uint64_t first_;
+    uint64_t stride_;
+    uint64_t count_;
+    
+    std::mutex open_mutex_;
+    std::vector<ScanResult> open_;
+    uint64_t closed_ = 0;
+    uint64_t filtered_ = 0;
+    std::atomic<uint64_t> completed_{0};
+};
+
+// Connect scan of one reactor's slice.
+//
+// A pool of `concurrency` worker coroutines pulls probes off the slice in
+// order. Before each connect a worker asks the congestion control for a
+// slot, and parks if the window is full or the rate cap is reached; parked
+// workers are offered the window again every millisecond. Each connect's
+// timeout sits on the reactor's timer wheel, so thousands of deadlines
+// cost nothing until one fires.
+//
+// With banners on, an open connection is handed to a coroutine of its own
+// that reads the service's greeting, or probes for a reply, and the worker
+// moves on to its next probe. Up to `concurrency` banners are read at
+// once; past that, workers read them themselves and stop probing until
+// they are done. The reactor stops itself when the last worker runs out
+// of probes and the last banner is in.
+class ConnectScanner : public ScanEngine {
+public:
+    ConnectScanner(const ScanConfig& config, AsyncIO& io, const ScanPlan& plan,
+                   uint64_t first, uint64_t stride)
+        : ScanEngine(plan, first, stride,
+                     {.min_rate = config.min_rate, .max_rate = config.max_rate,
+                      .max_window = config.concurrency},
+                     config.checkpoint, config.banners),
+          config_(config), io_(io) {}
+    
+    ~ConnectScanner() override {
+        io_.cancel(admit_timer_);
+    }
+    
+    void start() override {
+        workers_ = std::min<uint64_t>(config_.concurrency, count());
+        if (workers_ == 0) {
+            io_.schedule(duration::zero(), [this] { io_.stop(); });
+            return;
+        }
+        
+        // Spawn from inside the loop so a worker that finishes straight
+        // away cannot stop the reactor before it starts running; on a
+        // resumed slice they all do
+        io_.schedule(duration::zero(), [this, workers = workers_] {
+            for (size_t i = 0; i < workers; ++i) {
+                spawn(worker());
+            }
+        });
+    }
+
+private:
+    // Resumes the worker once the congestion control admits one more connect
+    struct Admission {
+        ConnectScanner& scanner;
+        
+        bool await_ready() { return scanner.admit(); }
+        
+        void await_suspend(std::coroutine_handle<> handle) {
+            scanner.parked_.push_back(handle);
+            scanner.schedule_admit();
+        }
+        
+        void await_resume() noexcept {}
+    };
+    
+    // Once the slice is used up, workers are let through without taking
+    // send credit so they can finish
+    bool admit() {
+        while (next_ < count() && resumed(next_)) ++next_;
+        if (next_ >= count()) return true;
+        if (!control_.try_send(steady_clock::now(), in_flight_)) return false;
+        ++in_flight_;
+        return true;
+    }
+    
+    void schedule_admit() {
+        if (admit_timer_ != TimerWheel::INVALID_TIMER) return;
+        
+        admit_timer_ = io_.schedule(ADMIT_INTERVAL, [this] {
+            admit_timer_ = TimerWheel::INVALID_TIMER;
+            while (!parked_.empty() && admit()) {
+                auto handle = parked_.front();
+                parked_.pop_front();
+                handle.resume();
+            }
+            if (!parked_.empty()) schedule_admit();
+        });
+    }
+    
+    Task<void> worker() {
+        while (true) {
+            co_await Admission{*this};
+            if (next_ >= count()) break;
+            
+            Probe probe = probe_at(next_++);
+            Socket conn;
+            PortState state = co_await try_connect(probe, conn);
+            --in_flight_;
+            
+            if (!conn.is_valid()) {
+                record(probe, state);
+            } else if (grabbing_ < config_.concurrency) {
+                ++grabbing_;
+                spawn(grab_banner(probe, std::move(conn)));
+            } else {
+                ++grabbing_;
+                co_await grab_banner(probe, std::move(conn));
+            }
+        }
+        
+        --workers_;
+        stop_when_done();
+    }
+    
+    void stop_when_done() {
+        if (workers_ == 0 && grabbing_ == 0) {
+            io_.stop();
+        }
+    }
+    
+    // Services that speak first, such as SSH, SMTP or FTP, greet straight
+    // away; the rest are sent a probe and given as long again to answer
+    Task<void> grab_banner(Probe probe, Socket conn) {
+        AsyncSocket sock(io_, std::move(conn));
+        char banner[BANNER_SIZE];
+        
+        auto res = co_await sock.recv(banner, sizeof(banner), BANNER_WAIT);
+        if (res.error == ETIMEDOUT) {
+            std::string_view payload = banner_probe(probe.port);
+            if (co_await sock.send(payload.data(), payload.size(), BANNER_WAIT)) {
+                res = co_await sock.recv(banner, sizeof(banner), BANNER_WAIT);
+            }
+        }
+        
+        size_t len = res ? res.bytes : 0;
+        while (len > 0 && len < sizeof(banner)) {
+            auto more = co_await sock.recv(banner + len, sizeof(banner) - len, BANNER_FOLLOWUP);
+            if (!more || more.bytes == 0) break;
+            len += more.bytes;
+        }
+        abort_connection(sock.socket());
+        
+        record(probe, PortState::OPEN, len > 0 ? identify({banner, len}) : Fingerprint{});
+        --grabbing_;
+        stop_when_done();
+    }
+    
+    // A timeout from a target that has answered before is retried once.
+    // If the retry is answered, the first attempt was dropped on the way,
+    // which is the congestion signal; if not, the port is filtered. With
+    // banners on, an open port's connection is left established in `conn`.
+    Task<PortState> try_connect(Probe probe, Socket& conn) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = probe.addr;
+        addr.sin_port = htons(probe.port);
+        
+        time_point first_sent{};
+        while (true) {
+            Socket raw(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+            if (!raw.is_valid()) {
+                if (errno != EMFILE && errno != ENFILE && errno != ENOBUFS) {
+                    co_return PortState::FILTERED;
+                }
+                co_await sleep_for(io_, RETRY_DELAY);
+                continue;
+            }
+            
+            AsyncSocket sock(io_, std::move(raw));
+            auto sent = steady_clock::now();
+            auto res = co_await sock.connect(addr, rtt_.timeout(probe.addr, MIN_TIMEOUT, config_.timeout));
+            auto now = steady_clock::now();
+            
+            if (res.error == 0 || res.error == ECONNREFUSED) {
+                if (first_sent == time_point{}) {
+                    rtt_.sample(probe.addr, now - sent);
+                } else {
+                    control_.on_loss(first_sent, now);
+                }
+                control_.on_reply();
+            }
+            
+            switch (res.error) {
+                case 0:
+                    if (is_self_connect(sock.socket(), addr)) {
+                        abort_connection(sock.socket());
+                        co_return PortState::CLOSED;
+                    }
+                    if (config_.banners) {
+                        conn = sock.release();
+                    } else {
+                        abort_connection(sock.socket());
+                    }
+                    co_return PortState::OPEN;
+                case ECONNREFUSED:
+                    co_return PortState::CLOSED;
+                case EADDRNOTAVAIL:
+                case EAGAIN:
+                    // Out of local ports; retry once some are released
+                    break;
+                case ETIMEDOUT:
+                    if (first_sent == time_point{} && rtt_.known(probe.addr)) {
+                        first_sent = sent;
+                        while (!control_.try_resend(steady_clock::now())) {
+                            co_await sleep_for(io_, ADMIT_INTERVAL);
+                        }
+                        continue;
+                    }
+                    control_.on_silence();
+                    co_return PortState::FILTERED;
+                default:
+                    // An ICMP error said the host or port is unreachable
+                    co_return PortState::FILTERED;
+            }
+            co_await sleep_for(io_, RETRY_DELAY);
+        }
+    }
+    
+    // A loopback connect to a closed port in the ephemeral range can be
+    // given that same port as its source and "succeed" by simultaneous open
+    static bool is_self_connect(const Socket& sock, const sockaddr_in& target) {
+        sockaddr_in local{};
+        socklen_t len = sizeof(local);
+        if (getsockname(sock.fd(), reinterpret_cast<sockaddr*>(&local), &len) != 0) {
+            return false;
+        }
+        return local.sin_port == target.sin_port &&
+               local.sin_addr.s_addr == target.sin_addr.s_addr;
+    }
+    
+    // Reset rather than close so open ports leave no TIME_WAIT
+    static void abort_connection(Socket& sock) {
+        linger lin{1, 0};
+        setsockopt(sock.fd(), SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+    }
+    
+    const ScanConfig& config_;
+    AsyncIO& io_;
+    uint64_t next_ = 0;
+    size_t workers_ = 0;
+    size_t grabbing_ = 0;
+    
+    size_t in_flight_ = 0;
+    std::deque<std::coroutine_handle<>> parked_;
+    AsyncIO::TimerId admit_timer_ = TimerWheel::INVALID_TIMER;
+};
+
+// Local address the kernel would send from to reach `target`
+Result<in_addr_t> source_address(in_addr_t target) {
+    Socket probe(Socket::Type::UDP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = target;
+    addr.sin_port = htons(9);
+    
+    sockaddr_in local{};
+    socklen_t len = sizeof(local);
+    if (::connect(probe.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        getsockname(probe.fd(), reinterpret_cast<sockaddr*>(&local), &len) < 0) {
+        return Result<in_addr_t>(std::format("No route to target: {}", std::strerror(errno)));
+    }
+    return local.sin_addr.s_addr;
+}
+
+// Raw TCP socket for a SYN scan. A socket filter drops everything but
+// segments to our source port before they are queued, so unrelated TCP
+// traffic on the host never reaches the receive path.
+Result<Socket> open_syn_socket(const ScanConfig& config) {
+    Socket sock(::socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP));
     if (!sock.is_valid()) {
-        return false;
+        if (errno == EPERM || errno == EACCES) {
+            return Result<Socket>("SYN scan needs root or CAP_NET_RAW");
+        }
+        return Result<Socket>(std::format("Failed to create raw socket: {}", std::strerror(errno)));
+    }
+    
+    // Loads from a raw IPv4 socket are relative to the IP header
+    sock_filter code[] = {
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),                         // IP header length
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),                          // TCP destination port
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, config.source_port, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, REPLY_SNAP),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    sock_fprog program{static_cast<unsigned short>(std::size(code)), code};
+    if (setsockopt(sock.fd(), SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0) {
+        return Result<Socket>(std::format("Failed to attach socket filter: {}", std::strerror(errno)));
     }
     
-    auto result = sock.connect(host, port, timeout);
-    return result.has_value();
+    // Replies to a fast sweep arrive in bursts
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(sock.fd(), SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    return sock;
 }
 
+// Probes sent from one shared socket, with no per-probe socket or kernel
+// state: the SYN and UDP scans on one reactor.
+//
+// The send path is a paced timer that writes probes as the congestion
+// control allows; the receive path is the socket's read handler, which
+// matches replies to the probes they answer. Neither waits on the other.
+//
+// Probes awaiting a reply sit in a fixed ring, walked by three cursors in
+// probe order: new probes go out at `next_`, probes silent for a timeout
+// are sent once more at `retry_`, and probes still silent a timeout after
+// that are retired as filtered at `base_`. A reply to a retried probe
+// means the first one was dropped, which is the congestion signal.
+class RingScanner : public ScanEngine {
+public:
+    RingScanner(const ScanConfig& config, AsyncIO& io, int fd, const ScanPlan& plan,
+                uint64_t first, uint64_t stride)
+        : ScanEngine(plan, first, stride,
+                     {.min_rate = config.min_rate, .max_rate = config.max_rate,
+                      .max_window = ring_size(config)},
+                     config.checkpoint),
+          config_(config), io_(io), fd_(fd),
+          slots_(ring_size(config)), slot_mask_(slots_.size() - 1) {}
+    
+    ~RingScanner() override {
+        io_.cancel(timer_);
+        io_.remove(fd_);
+    }
+    
+    void start() override {
+        io_.add(fd_, AsyncIO::Event::READ, [this](int, AsyncIO::Event) { on_readable(); });
+        timer_ = io_.schedule(duration::zero(), [this] { pump(); });
+    }
+
+protected:
+    enum : uint8_t {
+        WAITING,
+        DONE
+    };
+    
+    struct Slot {
+        time_point sent;            // First attempt
+        time_point deadline;        // Of the latest attempt
+        in_addr_t addr;
+        uint16_t port;
+        uint8_t state;
+        bool retried;
+        uint64_t index;             // In the scan plan
+    };
+    
+    // Send the probe in ring slot `index`; false if the socket buffer is
+    // full and it should be sent again later
+    virtual bool send_probe(uint64_t index) = 0;
+    
+    // End of a burst of send_probe() calls
+    virtual void flush() {}
+    
+    // The probe in `slot` is done with, answered or not
+    virtual void forget(const Slot&) {}
+    
+    virtual void on_readable() = 0;
+    
+    Slot& slot(uint64_t index) { return slots_[index & slot_mask_]; }
+    uint64_t slot_mask() const { return slot_mask_; }
+    
+    // A reply settled the probe in a waiting `slot`
+    void answer(Slot& slot, PortState state, time_point now) {
+        // Only a reply to a lone probe times the round trip unambiguously
+        if (slot.retried) {
+            control_.on_loss(slot.sent, now);
+        } else {
+            rtt_.sample(slot.addr, now - slot.sent);
+        }
+        control_.on_reply();
+        finish(slot, state);
+    }
+    
+    const ScanConfig& config_;
+    AsyncIO& io_;
+    int fd_;
+
+private:
+    // Room for every probe sent over two timeouts (the first attempt and
+    // its retry) with some slack; a full ring holds back new probes
+    static size_t ring_size(const ScanConfig& config) {
+        double needed = config.max_rate > 0
+            ? config.max_rate * 3 * std::chrono::duration<double>(config.timeout).count()
+            : static_cast<double>(MAX_RING_SIZE);
+        size_t size = 1024;
+        while (size < needed && size < MAX_RING_SIZE) size *= 2;
+        return size;
+    }
+    
+    void pump() {
+        timer_ = TimerWheel::INVALID_TIMER;
+        auto now = steady_clock::now();
+        size_t sent = 0;
+        
+        while (base_ < retry_) {
+            Slot& slot = this->slot(base_);
+            if (slot.state == WAITING) {
+                if (now < slot.deadline) break;
+                control_.on_silence();
+                finish(slot, PortState::FILTERED);
+            }
+            ++base_;
+        }
+        
+        while (retry_ < next_ && sent < SEND_BURST) {
+            Slot& slot = this->slot(retry_);
+            if (slot.state == WAITING) {
+                if (now < slot.deadline || !control_.try_resend(now)) break;
+                slot.deadline = now + rtt_.timeout(slot.addr, MIN_TIMEOUT, config_.timeout);
+                slot.retried = true;
+                if (!send_probe(retry_)) break;
+                ++sent;
+            }
+            ++retry_;
+        }
+        
+        while (next_ < count() && next_ - base_ < slots_.size() && sent < SEND_BURST) {
+            if (resumed(next_)) {
+                slot(next_++).state = DONE;
+                continue;
+            }
+            if (!control_.try_send(now, in_flight_)) break;
+            
+            Probe probe = probe_at(next_);
+            auto deadline = now + rtt_.timeout(probe.addr, MIN_TIMEOUT, config_.timeout);
+            slot(next_) = {now, deadline, probe.addr, probe.port, WAITING, false, probe.index};
+            if (!send_probe(next_)) break;
+            ++in_flight_;
+            ++sent;
+            ++next_;
+        }
+        flush();
+        
+        if (base_ == count()) {
+            io_.stop();
+            return;
+        }
+        
+        // A full burst continues straight after the receive path has had
+        // a turn; otherwise wait a tick
+        timer_ = io_.schedule(sent == SEND_BURST ? duration::zero() : duration(1ms), [this] { pump(); });
+    }
+    
+    void finish(Slot& slot, PortState state) {
+        slot.state = DONE;
+        --in_flight_;
+        forget(slot);
+        record({slot.addr, slot.port, slot.index}, state);
+    }
+    
+    std::vector<Slot> slots_;
+    uint64_t slot_mask_;
+    uint64_t base_ = 0;         // Oldest probe not yet retired
+    uint64_t retry_ = 0;        // Oldest probe not yet retried
+    uint64_t next_ = 0;         // Next probe to send
+    
+    size_t in_flight_ = 0;      // Probes awaiting a reply
+    AsyncIO::TimerId timer_ = TimerWheel::INVALID_TIMER;
+};
+
+// Half-open SYN scan on one reactor.
+//
+// Bare SYN segments go out on a raw socket and SYN-ACK (open) or RST
+// (closed) replies come back on it. No handshake is ever completed: the
+// kernel answers a SYN-ACK with a RST because nothing listens on our
+// source port. Each SYN's sequence number carries its ring slot under a
+// keyed hash of the target, so a reply finds its probe directly from the
+// acknowledgement number.
+class SynScanner : public RingScanner {
+public:
+    SynScanner(const ScanConfig& config, AsyncIO& io, int fd, const ScanPlan& plan,
+               uint64_t first, uint64_t stride)
+        : RingScanner(config, io, fd, plan, first, stride),
+          replies_(REPLY_BATCH * REPLY_SNAP) {}
+
+private:
+    bool send_probe(uint64_t index) override {
+        const Slot& slot = this->slot(index);
+        
+        struct {
+            tcphdr tcp;
+            uint8_t mss[4];
+        } segment{};
+        
+        // Look like an ordinary connect: a SYN with an MSS option
+        segment.tcp.source = htons(config_.source_port);
+        segment.tcp.dest = htons(slot.port);
+        segment.tcp.seq = htonl(sequence(slot.addr, slot.port, index & slot_mask()));
+        segment.tcp.doff = sizeof(segment) / 4;
+        segment.tcp.syn = 1;
+        segment.tcp.window = htons(1024);
+        segment.mss[0] = TCPOPT_MAXSEG;
+        segment.mss[1] = TCPOLEN_MAXSEG;
+        segment.mss[2] = 1460 >> 8;
+        segment.mss[3] = 1460 & 0xFF;
+        segment.tcp.check = transport_checksum(config_.source, slot.addr,
+            IPPROTO_TCP, &segment, sizeof(segment));
+        
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = slot.addr;
+        ssize_t n = ::sendto(fd_, &segment, sizeof(segment), MSG_DONTWAIT,
+            reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+        
+        // Any other failure (no route, blocked by a local firewall) leaves
+        // the probe unanswered, and so filtered
+        return n >= 0 || (errno != EAGAIN && errno != ENOBUFS);
+    }
+    
+    void on_readable() override {
+        mmsghdr msgs[REPLY_BATCH]{};
+        iovec iovs[REPLY_BATCH];
+        for (size_t i = 0; i < REPLY_BATCH; ++i) {
+            iovs[i] = {replies_.data() + i * REPLY_SNAP, REPLY_SNAP};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        
+        while (true) {
+            int n = recvmmsg(fd_, msgs, REPLY_BATCH, MSG_DONTWAIT, nullptr);
+            if (n <= 0) break;
+            
+            auto now = steady_clock::now();
+            for (int i = 0; i < n; ++i) {
+                handle_reply(replies_.data() + i * REPLY_SNAP, msgs[i].msg_len, now);
+            }
+            if (static_cast<size_t>(n) < REPLY_BATCH) break;
+        }
+    }
+    
+    void handle_reply(const uint8_t* data, size_t len, time_point now) {
+        if (len < sizeof(iphdr)) return;
+        
+        const auto* ip = reinterpret_cast<const iphdr*>(data);
+        size_t ip_header_len = ip->ihl * 4;
+        if (ip->protocol != IPPROTO_TCP || len < ip_header_len + sizeof(tcphdr)) return;
+        
+        const auto* tcp = reinterpret_cast<const tcphdr*>(data + ip_header_len);
+        if (ntohs(tcp->dest) != config_.source_port || !tcp->ack) return;
+        
+        // Our SYN's sequence number, which names the slot it was sent from
+        uint32_t seq = ntohl(tcp->ack_seq) - 1;
+        Slot& slot = this->slot(seq);
+        uint16_t port = ntohs(tcp->source);
+        if (slot.state != WAITING || slot.addr != ip->saddr || slot.port != port ||
+            seq != sequence(slot.addr, port, seq & slot_mask())) {
+            return;
+        }
+        
+        if (tcp->syn) {
+            answer(slot, PortState::OPEN, now);
+        } else if (tcp->rst) {
+            answer(slot, PortState::CLOSED, now);
+        }
+    }
+    
+    // Keyed hash of the target in the high bits, ring slot in the low ones
+    uint32_t sequence(in_addr_t addr, uint16_t port, uint64_t slot) const {
+        uint32_t x = config_.secret ^ addr ^ (port * 0x9E3779B1u);
+        x ^= x >> 16;
+        x *= 0x85EBCA6Bu;
+        x ^= x >> 13;
+        x *= 0xC2B2AE35u;
+        x ^= x >> 16;
+        return (x & ~static_cast<uint32_t>(slot_mask())) | static_cast<uint32_t>(slot);
+    }
+    
+    std::vector<uint8_t> replies_;
+};
+
+// UDP socket for a UDP scan. ICMP errors for datagrams it sent are queued
+// on its error queue, which tells closed ports from silent ones.
+Result<Socket> open_udp_socket() {
+    Socket sock(::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (!sock.is_valid()) {
+        return Result<Socket>(std::format("Failed to create UDP socket: {}", std::strerror(errno)));
+    }
+    
+    int on = 1;
+    if (setsockopt(sock.fd(), IPPROTO_IP, IP_RECVERR, &on, sizeof(on)) < 0) {
+        return Result<Socket>(std::format("Failed to enable IP_RECVERR: {}", std::strerror(errno)));
+    }
+    
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(sock.fd(), SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    return sock;
+}
+
+// UDP scan on one reactor.
+//
+// Datagrams carry the payload of the port's service from the service
+// table, and go out in sendmmsg() batches from one unconnected socket. A
+// reply from the target port means open; an ICMP port unreachable, read
+// from the socket's error queue, means closed; other ICMP unreachables
+// mean filtered. Silence is reported as filtered, though to UDP it means
+// open or filtered. Probes are found again by target address and port.
+class UdpScanner : public RingScanner {
+public:
+    UdpScanner(const ScanConfig& config, AsyncIO& io, int fd, const ScanPlan& plan,
+               uint64_t first, uint64_t stride)
+        : RingScanner(config, io, fd, plan, first, stride),
+          replies_(REPLY_BATCH * REPLY_SNAP) {}
+
+private:
+    static uint64_t key(in_addr_t addr, uint16_t port) {
+        return (static_cast<uint64_t>(addr) << 16) | port;
+    }
+    
+    bool send_probe(uint64_t index) override {
+        const Slot& slot = this->slot(index);
+        if (!slot.retried) waiting_[key(slot.addr, slot.port)] = index;
+        
+        const Service* service = find_service(Protocol::UDP, slot.port);
+        std::string_view payload = service ? service->probe : std::string_view{};
+        
+        size_t i = batched_++;
+        batch_addrs_[i] = {};
+        batch_addrs_[i].sin_family = AF_INET;
+        batch_addrs_[i].sin_addr.s_addr = slot.addr;
+        batch_addrs_[i].sin_port = htons(slot.port);
+        batch_iovs_[i] = {const_cast<char*>(payload.data()), payload.size()};
+        
+        if (batched_ == SEND_BATCH) flush();
+        return true;
+    }
+    
+    // A datagram the socket buffer had no room for is lost like one
+    // dropped on the way, and goes out again as a retry
+    void flush() override {
+        mmsghdr msgs[SEND_BATCH]{};
+        for (size_t i = 0; i < batched_; ++i) {
+            msgs[i].msg_hdr.msg_name = &batch_addrs_[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &batch_iovs_[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        
+        size_t done = 0;
+        while (done < batched_) {
+            int n = sendmmsg(fd_, msgs + done, batched_ - done, MSG_DONTWAIT);
+            if (n > 0) {
+                done += n;
+            } else if (n < 0 && errno != EAGAIN && errno != ENOBUFS) {
+                // Unroutable or refused locally; skip that datagram
+                ++done;
+            } else {
+                break;
+            }
+        }
+        batched_ = 0;
+    }
+    
+    void forget(const Slot& slot) override {
+        waiting_.erase(key(slot.addr, slot.port));
+    }
+    
+    Slot* find(in_addr_t addr, uint16_t port) {
+        auto it = waiting_.find(key(addr, port));
+        return it != waiting_.end() ? &slot(it->second) : nullptr;
+    }
+    
+    void on_readable() override {
+        read_replies();
+        read_errors();
+    }
+    
+    void read_replies() {
+        mmsghdr msgs[REPLY_BATCH]{};
+        iovec iovs[REPLY_BATCH];
+        sockaddr_in from[REPLY_BATCH];
+        for (size_t i = 0; i < REPLY_BATCH; ++i) {
+            iovs[i] = {replies_.data() + i * REPLY_SNAP, REPLY_SNAP};
+            msgs[i].msg_hdr.msg_name = &from[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        
+        while (true) {
+            int n = recvmmsg(fd_, msgs, REPLY_BATCH, MSG_DONTWAIT, nullptr);
+            if (n <= 0) break;
+            
+            auto now = steady_clock::now();
+            for (int i = 0; i < n; ++i) {
+                Slot* slot = find(from[i].sin_addr.s_addr, ntohs(from[i].sin_port));
+                if (slot) answer(*slot, PortState::OPEN, now);
+                msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+            }
+            if (static_cast<size_t>(n) < REPLY_BATCH) break;
+        }
+    }
+    
+    // Each queued error names the datagram's original destination
+    void read_errors() {
+        alignas(cmsghdr) char control[REPLY_BATCH][CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in))];
+        mmsghdr msgs[REPLY_BATCH]{};
+        sockaddr_in dest[REPLY_BATCH];
+        for (size_t i = 0; i < REPLY_BATCH; ++i) {
+            msgs[i].msg_hdr.msg_name = &dest[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(dest[i]);
+            msgs[i].msg_hdr.msg_control = control[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        }
+        
+        while (true) {
+            int n = recvmmsg(fd_, msgs, REPLY_BATCH, MSG_ERRQUEUE | MSG_DONTWAIT, nullptr);
+            if (n <= 0) break;
+            
+            auto now = steady_clock::now();
+            for (int i = 0; i < n; ++i) {
+                handle_error(msgs[i].msg_hdr, dest[i], now);
+                msgs[i].msg_hdr.msg_namelen = sizeof(dest[i]);
+                msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+            }
+            if (static_cast<size_t>(n) < REPLY_BATCH) break;
+        }
+    }
+    
+    void handle_error(msghdr& msg, const sockaddr_in& dest, time_point now) {
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != IPPROTO_IP || cmsg->cmsg_type != IP_RECVERR) continue;
+            
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ICMP || err.ee_type != ICMP_DEST_UNREACH) continue;
+            
+            Slot* slot = find(dest.sin_addr.s_addr, ntohs(dest.sin_port));
+            if (!slot) continue;
+            
+            answer(*slot, err.ee_code == ICMP_PORT_UNREACH ? PortState::CLOSED
+                                                           : PortState::FILTERED, now);
+        }
+    }
+    
+    std::unordered_map<uint64_t, uint64_t> waiting_;    // Target -> ring index
+    
+    size_t batched_ = 0;
+    sockaddr_in batch_addrs_[SEND_BATCH];
+    iovec batch_iovs_[SEND_BATCH];
+    std::vector<uint8_t> replies_;
+};
+
 } // anonymous namespace
 
 int scan(std::span<const char*> args) {
-    ArgParser parser("Scan TCP ports on a host");
-    parser.add_positional("host", "Target host");
-    parser.add_positional("ports", "Port range (e.g., 1-1024 or 80,443,8080)");
-    parser.add_option("timeout", "t", "Timeout per port (ms)", "500");
-    parser.add_option("threads", "T", "Number of threads", "100");
+    ArgParser parser("Scan TCP or UDP ports on one or more hosts");
+    parser.add_positional("target", "Host, address or CIDR block (e.g., 10.0.0.0/24)", false);
+    parser.add_positional("ports", "Ports (e.g., 1-1024 or 22,80,8000-8100)");
+    parser.add_option("input-list", "iL", "Read targets from a file, one per line");
+    parser.add_option("timeout", "t", "Longest wait per port (ms)", "500");
+    parser.add_option("concurrency", "c", "Most connects in flight at once", "4096");
+    parser.add_option("cores", "", "Reactor threads, one per core (default: all cores)");
+    parser.add_option("io-backend", "", "Event loop backend: epoll, io_uring or auto", "auto");
+    parser.add_flag("syn", "S", "Half-open SYN scan over a raw socket (needs root)");
+    parser.add_flag("udp", "U", "UDP scan with service-specific payloads");
+    parser.add_option("max-rate", "r", "Most probes per second (0: unlimited)", "0");
+    parser.add_option("min-rate", "", "Fewest probes per second, whatever the losses", "0");
+    parser.add_flag("banners", "b", "Read banners from open ports to identify services");
+    parser.add_option("resume", "", "Save progress to a file, and continue from it if it exists");
     parser.add_flag("json", "j", "Output in JSON format");
     
     auto parse_result = parser.parse(args);
@@ -59,120 +1075,357 @@ int scan(std::span<const char*> args) {
         return 1;
     }
     
+    auto input_list = parser.get("input-list");
     auto positional = parser.get_positional();
-    if (positional.size() < 2) {
+    if (positional.size() < (input_list ? 1 : 2)) {
         std::cerr << ansi::error("Missing required arguments") << "\n";
         return 1;
     }
     
-    std::string host = positional[0];
-    std::string port_spec = positional[1];
+    std::string port_spec = positional.back();
     size_t timeout = parser.get_as<size_t>("timeout").value_or(500);
-    size_t num_threads = parser.get_as<size_t>("threads").value_or(100);
+    size_t concurrency = parser.get_as<size_t>("concurrency").value_or(DEFAULT_CONCURRENCY);
+    size_t cores = parser.get_as<size_t>("cores").value_or(Runtime::available_cores());
+    auto backend = AsyncIO::parse_backend(parser.get("io-backend").value_or("auto"));
+    if (!backend) {
+        std::cerr << ansi::error("I/O backend must be epoll, io_uring or auto") << "\n";
+        return 1;
+    }
+    bool syn = parser.get_flag("syn");
+    bool udp = parser.get_flag("udp");
+    double max_rate = parser.get_as<double>("max-rate").value_or(0);
+    double min_rate = parser.get_as<double>("min-rate").value_or(0);
+    bool banners = parser.get_flag("banners");
+    auto resume = parser.get("resume");
     bool json = parser.get_flag("json");
     
-    // Parse port specification
-    std::vector<uint16_t> ports;
+    // Targets are resolved once, up front; blocks stay unexpanded
+    TargetSet targets;
+    if (input_list) {
+        auto res = targets.add_file(*input_list);
+        if (!res) {
+            std::cerr << ansi::error(res.error) << "\n";
+            return 1;
+        }
+    }
+    if (positional.size() >= 2) {
+        auto res = targets.add(positional[0]);
+        if (!res) {
+            std::cerr << ansi::error(std::format("Failed to resolve {}", res.error)) << "\n";
+            return 1;
+        }
+    }
     
-    if (port_spec.find('-') != std::string::npos) {
-        // Range: 1-1024
-        auto dash_pos = port_spec.find('-');
-        int start = std::stoi(port_spec.substr(0, dash_pos));
-        int end = std::stoi(port_spec.substr(dash_pos + 1));
-        
-        for (int p = start; p <= end && p <= 65535; ++p) {
-            ports.push_back(p);
-        }
-    } else if (port_spec.find(',') != std::string::npos) {
-        // List: 80,443,8080
-        size_t pos = 0;
-        while (pos < port_spec.length()) {
-            size_t comma = port_spec.find(',', pos);
-            if (comma == std::string::npos) comma = port_spec.length();
-            
-            int port = std::stoi(port_spec.substr(pos, comma - pos));
-            ports.push_back(port);
-            pos = comma + 1;
+    auto ports = parse_ports(port_spec);
+    if (!ports) {
+        std::cerr << ansi::error(ports.error) << "\n";
+        return 1;
+    }
+    if (targets.empty()) {
+        std::cerr << ansi::error("No targets to scan") << "\n";
+        return 1;
+    }
+    if (concurrency == 0) {
+        std::cerr << ansi::error("Concurrency must be at least 1") << "\n";
+        return 1;
+    }
+    if (syn && udp) {
+        std::cerr << ansi::error("Choose either a SYN or a UDP scan") << "\n";
+        return 1;
+    }
+    if (banners && (syn || udp)) {
+        std::cerr << ansi::error("Banners are only read in a connect scan") << "\n";
+        return 1;
+    }
+    if (min_rate < 0 || max_rate < 0) {
+        std::cerr << ansi::error("Rates must not be negative") << "\n";
+        return 1;
+    }
+    if (max_rate > 0 && min_rate > max_rate) {
+        std::cerr << ansi::error("Minimum rate is above the maximum rate") << "\n";
+        return 1;
+    }
+    
+    // A resumed scan keeps the probe order it was saved with
+    std::random_device random;
+    Protocol protocol = udp ? Protocol::UDP : Protocol::TCP;
+    uint64_t seed = (uint64_t{random()} << 32) | random();
+    Checkpoint checkpoint;
+    if (resume) {
+        auto res = Checkpoint::open(*resume, plan_digest(targets, *ports, protocol),
+                                    targets.size() * ports->size(), seed);
+        if (!res) {
+            std::cerr << ansi::error(res.error) << "\n";
+            return 1;
+        }
+        checkpoint = std::move(*res);
+        seed = checkpoint.seed();
+    }
+    
+    ScanPlan plan(targets, std::move(*ports), seed);
+    uint64_t total = plan.size();
+    
+    // A single host keeps the familiar summary table; several hosts
+    // stream each open port as it is found
+    bool single = targets.size() == 1;
+    std::string target_name = single && positional.size() >= 2 ? positional[0]
+                                                                 : ip_string(targets.at(0));
+    
+    ScanConfig config;
+    config.timeout = std::chrono::milliseconds(timeout);
+    config.banners = banners;
+    config.checkpoint = checkpoint.is_open() ? &checkpoint : nullptr;
+    
+    // A SYN scan is one raw socket on one reactor, a UDP scan one socket
+    // per reactor; a connect scan holds an fd per in-flight connect,
+    // spread over every core
+    Socket syn_sock;
+    std::vector<Socket> udp_socks;
+    if (syn) {
+        auto source = source_address(targets.at(0));
+        if (!source) {
+            std::cerr << ansi::error(source.error) << "\n";
+            return 1;
+        }
+        
+        config.source = *source;
+        config.source_port = static_cast<uint16_t>(32768 + random() % 28232);
+        config.secret = random();
+        
+        auto sock_result = open_syn_socket(config);
+        if (!sock_result) {
+            std::cerr << ansi::error(sock_result.error) << "\n";
+            return 1;
+        }
+        syn_sock = std::move(*sock_result);
+        cores = 1;
+    } else if (udp) {
+        cores = std::clamp<uint64_t>(cores, 1, total);
+        for (size_t i = 0; i < cores; ++i) {
+            auto sock_result = open_udp_socket();
+            if (!sock_result) {
+                std::cerr << ansi::error(sock_result.error) << "\n";
+                return 1;
+            }
+            udp_socks.push_back(std::move(*sock_result));
         }
     } else {
-        // Single port
-        ports.push_back(std::stoi(port_spec));
+        // Every in-flight connect holds an fd, and so does every banner
+        // being read; stay inside the limit
+        size_t per_connect = banners ? 2 : 1;
+        size_t fd_limit = raise_fd_limit(concurrency * per_connect + RESERVED_FDS);
+        if (fd_limit < RESERVED_FDS + per_connect) {
+            std::cerr << ansi::error(std::format("File descriptor limit too low ({})", fd_limit)) << "\n";
+            return 1;
+        }
+        concurrency = std::min(concurrency, (fd_limit - RESERVED_FDS) / per_connect);
+        cores = std::clamp<uint64_t>(cores, 1, std::min<uint64_t>(concurrency, total));
+        config.concurrency = std::max<size_t>(1, concurrency / cores);
     }
     
+    // Each reactor paces its own share of the rate bounds
+    config.min_rate = min_rate / cores;
+    config.max_rate = max_rate / cores;
+    
     if (!json) {
-        std::cout << ansi::info(std::format("Scanning {} ports on {}...\n", 
-            ports.size(), host));
+        std::string pace = syn ? "SYN scan"
+                         : udp ? "UDP scan"
+                               : std::format("up to {} in flight", config.concurrency * cores);
+        if (max_rate > 0) pace += std::format(", at most {:.0f} probes/s", max_rate);
+        if (min_rate > 0) pace += std::format(", at least {:.0f} probes/s", min_rate);
+        std::string where = single
+            ? std::format("{} ({})", target_name, ip_string(targets.at(0)))
+            : std::format("{} hosts ({} probes)", targets.size(), total);
+        std::cout << ansi::info(std::format("Scanning {} ports on {}, {}...\n",
+            plan.port_count(), where, pace));
     }
     
-    std::vector<ScanResult> results;
-    std::mutex results_mutex;
-    std::atomic<size_t> completed{0};
+    // Outcomes saved by an earlier run count towards this one; their open
+    // ports are reported with the new ones, or probed again to read their
+    // banners, which the checkpoint does not keep
+    std::vector<ScanResult> earlier;
+    uint64_t resumed = 0;
+    uint64_t closed = 0;
+    uint64_t filtered = 0;
+    if (checkpoint.is_open()) {
+        for (uint64_t i = 0; i < total; ++i) {
+            switch (checkpoint.get(i)) {
+                case Checkpoint::State::PENDING:
+                    continue;
+                case Checkpoint::State::OPEN: {
+                    if (banners) continue;
+                    Probe probe = plan.probe(i);
+                    earlier.push_back({probe.addr, probe.port, PortState::OPEN, {}, {}});
+                    break;
+                }
+                case Checkpoint::State::CLOSED:
+                    ++closed;
+                    break;
+                case Checkpoint::State::FILTERED:
+                    ++filtered;
+                    break;
+            }
+            ++resumed;
+        }
+        if (!json && resumed == total) {
+            std::cout << ansi::info(std::format("The scan saved in {} is already complete; "
+                "reporting its results\n", *resume));
+        } else if (!json && resumed > 0) {
+            std::cout << ansi::info(std::format("Resuming from {}: {} of {} probes already done\n",
+                *resume, resumed, total));
+        }
+    }
     
-    ansi::ProgressBar progress(ports.size());
+    // Reactor i takes probes i, i + cores, ... of the plan
+    Runtime runtime({.cores = cores, .backend = *backend});
+    std::vector<std::unique_ptr<ScanEngine>> shards(cores);
     
-    // Thread pool for scanning
-    std::vector<std::thread> threads;
-    std::atomic<size_t> next_port{0};
+    runtime.start([&](size_t index, AsyncIO& io) {
+        if (syn) {
+            shards[index] = std::make_unique<SynScanner>(config, io, syn_sock.fd(), plan, index, cores);
+        } else if (udp) {
+            shards[index] = std::make_unique<UdpScanner>(config, io, udp_socks[index].fd(), plan, index, cores);
+        } else {
+            shards[index] = std::make_unique<ConnectScanner>(config, io, plan, index, cores);
+        }
+        shards[index]->start();
+    });
     
-    auto scan_worker = [&]() {
-        while (true) {
-            size_t idx = next_port.fetch_add(1);
-            if (idx >= ports.size()) break;
-            
-            uint16_t port = ports[idx];
-            bool is_open = scan_port(host, port, std::chrono::milliseconds(timeout));
-            
-            if (is_open) {
-                std::lock_guard lock(results_mutex);
-                results.push_back({port, true, get_service_name(port)});
-            }
-            
-            size_t done = completed.fetch_add(1) + 1;
-            if (!json) {
-                progress.update(done);
+    auto completed = [&]() {
+        uint64_t done = 0;
+        for (auto& shard : shards) done += shard->completed();
+        return done;
+    };
+    
+    // A UDP port that stays silent may be open with nothing to say
+    std::string silent = udp ? "open|filtered" : "filtered";
+    
+    std::vector<ScanResult> results;
+    uint64_t open_count = 0;
+    ansi::ProgressBar progress(total);
+    
+    // Several hosts are printed as their open ports are found
+    auto report = [&](ScanResult result) {
+        ++open_count;
+        if (result.service.empty()) {
+            result.service = get_service_name(result.port, protocol);
+        }
+        if (single) {
+            results.push_back(std::move(result));
+        } else if (json) {
+            std::string version = banners
+                ? std::format(", \"version\": \"{}\"", json_escape(result.version)) : "";
+            std::cout << std::format("{{\"host\": \"{}\", \"port\": {}, \"service\": \"{}\"{}}}\n",
+                ip_string(result.host), result.port, result.service, version);
+        } else {
+            progress.clear();
+            std::cout << std::format("  {:<22} {}  {}\n",
+                std::format("{}:{}", ip_string(result.host), result.port),
+                ansi::success("open"),
+                result.version.empty() ? result.service
+                                       : std::format("{:<12} {}", result.service, result.version));
+        }
+    };
+    
+    // Collect what the reactors found
+    auto drain = [&]() {
+        for (auto& shard : shards) {
+            for (auto& result : shard->take_open()) {
+                report(std::move(result));
             }
         }
+        std::cout.flush();
     };
     
-    for (size_t i = 0; i < num_threads; ++i) {
-        threads.emplace_back(scan_worker);
+    for (auto& result : earlier) {
+        report(std::move(result));
     }
     
-    for (auto& t : threads) {
-        t.join();
+    // Live send rate and congestion window, summed over the reactors
+    auto status = [&]() {
+        double rate = 0;
+        double window = 0;
+        for (auto& shard : shards) {
+            rate += shard->rate();
+            window += shard->window();
+        }
+        return std::format("{:.0f} probes/s, window {:.0f}", rate, window);
+    };
+    
+    auto last_flush = steady_clock::now();
+    while (resumed + completed() < total) {
+        drain();
+        if (!json) {
+            progress.update(resumed + completed(), status());
+        }
+        if (steady_clock::now() - last_flush >= CHECKPOINT_INTERVAL) {
+            checkpoint.flush();
+            last_flush = steady_clock::now();
+        }
+        std::this_thread::sleep_for(50ms);
     }
+    runtime.join();
+    drain();
+    checkpoint.sync();
     
     if (!json) {
         progress.finish();
     }
     
+    for (auto& shard : shards) {
+        closed += shard->closed();
+        filtered += shard->filtered();
+    }
+    
+    if (!single) {
+        if (json) {
+            std::cout << std::format("{{\"targets\": {}, \"ports\": {}, \"protocol\": \"{}\", \"open\": {}, \"closed\": {}, \"filtered\": {}}}\n",
+                targets.size(), plan.port_count(), udp ? "udp" : "tcp", open_count, closed, filtered);
+        } else {
+            std::cout << "\n" << ansi::success(std::format("Found {} open ports across {} hosts",
+                open_count, targets.size()));
+            std::cout << std::format(" ({} closed, {} {})\n", closed, filtered, silent);
+        }
+        return 0;
+    }
+    
     // Sort results by port
     std::sort(results.begin(), results.end(), [](const auto& a, const auto& b) {
         return a.port < b.port;
     });
     
     if (json) {
-        std::cout << "{\n  \"host\": \"" << host << "\",\n";
+        std::cout << "{\n  \"host\": \"" << target_name << "\",\n";
+        std::cout << std::format("  \"protocol\": \"{}\",\n", udp ? "udp" : "tcp");
+        std::cout << std::format("  \"closed\": {},\n  \"filtered\": {},\n", closed, filtered);
         std::cout << "  \"open_ports\": [\n";
         for (size_t i = 0; i < results.size(); ++i) {
-            std::cout << std::format("    {{\"port\": {}, \"service\": \"{}\"}}",
-                results[i].port, results[i].service);
+            std::string version = banners
+                ? std::format(", \"version\": \"{}\"", json_escape(results[i].version)) : "";
+            std::cout << std::format("    {{\"port\": {}, \"service\": \"{}\"{}}}",
+                results[i].port, results[i].service, version);
             if (i < results.size() - 1) std::cout << ",";
             std::cout << "\n";
         }
         std::cout << "  ]\n}\n";
     } else {
-        std::cout << "\n" << ansi::success(std::format("Found {} open ports:\n\n", 
+        std::cout << "\n" << ansi::success(std::format("Found {} open ports",
             results.size()));
+        std::cout << std::format(" ({} closed, {} {}):\n\n", closed, filtered, silent);
         
         if (!results.empty()) {
-            ansi::Table table({"Port", "State", "Service"});
+            std::vector<std::string> headers = {"Port", "State", "Service"};
+            if (banners) headers.push_back("Version");
+            
+            ansi::Table table(headers);
             for (const auto& result : results) {
-                table.add_row({
+                std::vector<std::string> row = {
                     std::format("{}", result.port),
                     ansi::success("open"),
                     result.service
-                });
+                };
+                if (banners) row.push_back(result.version);
+                table.add_row(row);
             }
             std::cout << table.render();
         }
@@ -3,63 +3,749 @@
 #include "../stats.h"
 #include "../ansi.h"
 #include "../argparse.h"
+#include "../async_io.h"
+#include "../packet.h"
+#include "../timestamps.h"
+#include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
 #include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include <algorithm>
+#include <array>
+#include <csignal>
+#include <cmath>
+#include <cstring>
+#include <deque>
 #include <iostream>
 #include <format>
-#include <thread>
+#include <functional>
+#include <iterator>
+#include <vector>
 
 namespace netprobe::commands {
 
 namespace {
 
-Result<std::pair<std::string, double>> probe_hop(const sockaddr_in& dest, int ttl) {
-    Socket sock(Socket::Type::UDP);
-    if (!sock.is_valid()) {
-        return Result<std::pair<std::string, double>>("Failed to create UDP socket");
+constexpr uint16_t BASE_PORT = 33434; // Standard traceroute port
+
+// How probes are told apart, which decides the paths they take through
+// routers that balance load per flow (addresses, ports and protocol)
+enum class TraceMode {
+    CLASSIC,    // A destination port per probe, so every probe is a flow
+    PARIS,      // One flow throughout; probes are named by UDP checksum
+    MDA         // A flow per query, named by checksum, and as many
+                // queries as it takes to find every next hop
+};
+
+// The Multipath Detection Algorithm stops probing a hop once it is this
+// sure that no interface is left unseen, or at this many interfaces
+constexpr double MDA_CONFIDENCE = 0.95;
+constexpr size_t MDA_MAX_INTERFACES = 16;
+
+// Probes a hop needs after `interfaces` have answered to rule out one
+// more: were there one more, evenly balanced, all of them missing it must
+// be less likely than its share of the error allowed
+size_t mda_probes(size_t interfaces) {
+    double k = static_cast<double>(std::max<size_t>(interfaces, 1));
+    double alpha = (1 - MDA_CONFIDENCE) / (k + 1);
+    return static_cast<size_t>(std::ceil(std::log(alpha) / std::log(k / (k + 1))));
+}
+
+struct TraceConfig {
+    TraceMode mode = TraceMode::CLASSIC;
+    size_t max_hops = 30;
+    size_t queries = 3;         // Probes per hop, but for MDA
+    duration pace{};            // Between probes; zero sends all at once
+    duration timeout = 2s;
+    bool continuous = false;    // A round of queries every interval, indefinitely
+    duration interval = 1s;
+};
+
+// Room for probes per hop. A continuous trace reuses the room round after
+// round, and keeps enough of it that a probe has timed out before its
+// slot, and so its id, is taken by a later one.
+size_t slots_per_hop(const TraceConfig& config) {
+    if (config.mode == TraceMode::MDA) return mda_probes(MDA_MAX_INTERFACES);
+    if (!config.continuous) return config.queries;
+    size_t rounds = static_cast<size_t>(config.timeout / config.interval) + 2;
+    return config.queries * rounds;
+}
+
+std::string ip_string(in_addr addr) {
+    char buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr, buf, sizeof(buf));
+    return buf;
+}
+
+// A probe's UDP segment. The payload is picked so that the checksum the
+// kernel fills in comes out as the probe's id: the checksum is a one's
+// complement sum, so it moves with the payload one for one.
+struct ProbeSegment {
+    udphdr header;
+    uint16_t pad;
+};
+
+uint16_t checksum_pad(in_addr_t source, in_addr_t dest, ProbeSegment segment, uint16_t id) {
+    segment.header.check = 0;
+    segment.pad = 0;
+    uint32_t sum = static_cast<uint16_t>(~htons(id)) +
+                   transport_checksum(source, dest, IPPROTO_UDP, &segment, sizeof(segment));
+    return static_cast<uint16_t>((sum & 0xFFFF) + (sum >> 16));
+}
+
+uint16_t checksum_id(in_addr_t source, in_addr_t dest, ProbeSegment segment) {
+    segment.header.check = 0;
+    return ntohs(transport_checksum(source, dest, IPPROTO_UDP, &segment, sizeof(segment)));
+}
+
+// One probe and what it drew
+struct HopProbe {
+    enum : uint8_t {
+        UNUSED,
+        WAITING,
+        ANSWERED,
+        EXPIRED
+    };
+    
+    time_point sent;
+    KernelTimestamp sent_stamp;
+    in_addr from{};
+    double rtt = 0;
+    TimestampSource source = TimestampSource::USERSPACE;
+    uint8_t state = UNUSED;
+};
+
+// Every hop of a route probed at once over one UDP socket, driven by an
+// event loop.
+//
+// Probes go out TTL by TTL, each query of a hop before the next hop, as
+// fast as the pacing allows; nothing waits for a reply. Routers answer
+// the probes that expire on them with TTL exceeded, and the destination
+// answers those that reach it with port unreachable. Every probe carries
+// an id the error quotes back, in its destination port or its checksum,
+// so replies are matched to probes in any order and the trace takes
+// about one round trip to its slowest hop rather than one per probe.
+//
+// Only the probes up to the first TTL that reached the destination
+// matter: the later ones reach it too, and a host that rate-limits ICMP
+// answers the earliest. The trace is done once those are all answered or
+// timed out, and sends no more beyond them. Under MDA a hop that reveals
+// a new interface is sent more probes, on new flows, as they come in.
+//
+// The errors come in on a raw ICMP socket where netprobe may open one;
+// otherwise the kernel queues them on the UDP socket itself under
+// IP_RECVERR, which needs no privilege. That queue gives the destination
+// port and any payload the router quoted, but not the checksum, so a
+// checksum id is recovered from the payload it was made with. The send
+// stamps that time the probes come through the UDP socket's error queue
+// either way.
+//
+// A continuous trace sends a round like the first every interval, to the
+// hops up to the destination, through a fixed ring of probe slots per
+// hop; each probe is handed to a callback as it is answered or expires.
+class Tracer {
+public:
+    using Callback = std::function<void(size_t ttl, const HopProbe& probe)>;
+    
+    Tracer(AsyncIO& io, const sockaddr_in& dest, const TraceConfig& config)
+        : io_(io), dest_(dest), config_(config), per_hop_(slots_per_hop(config)),
+          probes_(config.max_hops * per_hop_), wanted_(config.max_hops),
+          pending_(config.max_hops), stamp_keys_(probes_.size()) {}
+    
+    ~Tracer() {
+        io_.cancel(timer_);
+        if (send_.is_valid()) io_.remove(send_.fd());
+        if (recv_.is_valid()) io_.remove(recv_.fd());
+    }
+    
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+    
+    Result<void> open() {
+        // The checksum covers the source address, so it is pinned to the
+        // one the route to the destination would pick
+        Socket route(Socket::Type::UDP);
+        sockaddr_in local{};
+        socklen_t len = sizeof(local);
+        if (::connect(route.fd(), reinterpret_cast<const sockaddr*>(&dest_), sizeof(dest_)) < 0 ||
+            getsockname(route.fd(), reinterpret_cast<sockaddr*>(&local), &len) < 0) {
+            return Result<void>(std::format("No route to {}: {}", ip_string(dest_.sin_addr),
+                                            std::strerror(errno)));
+        }
+        
+        if (auto res = send_.create(Socket::Type::UDP); !res) {
+            return res;
+        }
+        
+        // Bound up front, so the source port quoted in errors is known
+        local.sin_port = 0;
+        len = sizeof(local);
+        if (::bind(send_.fd(), reinterpret_cast<const sockaddr*>(&local), sizeof(local)) < 0 ||
+            getsockname(send_.fd(), reinterpret_cast<sockaddr*>(&local), &len) < 0) {
+            return Result<void>(std::format("Bind failed: {}", std::strerror(errno)));
+        }
+        source_ = local.sin_addr.s_addr;
+        port_ = local.sin_port;
+        
+        // A ping socket only sees echo replies, so it is no use here; the
+        // error queue stands in for a raw socket only without the privilege
+        if (auto res = recv_.create(Socket::Type::ICMP_RAW); !res) {
+            if (errno != EPERM && errno != EACCES) {
+                return res;
+            }
+            int on = 1;
+            setsockopt(send_.fd(), SOL_IP, IP_RECVERR, &on, sizeof(on));
+        }
+        raw_ = recv_.is_valid();
+        
+        stamps_ = enable_timestamps(send_.fd()) && (!raw_ || enable_timestamps(recv_.fd()));
+        return Result<void>();
+    }
+    
+    void start() {
+        start_ = steady_clock::now();
+        for (size_t ttl = 1; ttl <= config_.max_hops; ++ttl) {
+            want(ttl, config_.mode == TraceMode::MDA ? mda_probes(1) : config_.queries);
+        }
+        
+        // Error events carry the queued errors and send stamps
+        io_.add(send_.fd(), AsyncIO::Event::ERROR, [this](int, AsyncIO::Event) { on_event(); });
+        if (raw_) {
+            io_.add(recv_.fd(), AsyncIO::Event::READ, [this](int, AsyncIO::Event) { on_event(); });
+        }
+        timer_ = io_.schedule(duration::zero(), [this] { pump(); });
     }
     
-    sock.set_ttl(ttl);
-    sock.set_timeout(2000ms);
+    // Another round of queries. A round still going out under a slow pace
+    // holds back the next, so the queue stays bounded.
+    void next_round() {
+        if (!queue_.empty()) return;
+        
+        start_ = steady_clock::now();
+        sends_ = 0;
+        size_t hops = reached_ ? reached_ : config_.max_hops;
+        for (size_t ttl = 1; ttl <= hops; ++ttl) {
+            want(ttl, wanted_[ttl - 1] + config_.queries);
+        }
+        io_.cancel(timer_);
+        pump();
+    }
+    
+    void on_complete(Callback callback) { on_complete_ = std::move(callback); }
+    
+    bool done() const {
+        size_t hops = reached_ ? reached_ : config_.max_hops;
+        return std::all_of(pending_.begin(), pending_.begin() + hops,
+                           [](size_t pending) { return pending == 0; });
+    }
     
-    // Create ICMP socket to receive TTL exceeded messages
-    Socket icmp_sock(Socket::Type::ICMP);
-    if (!icmp_sock.is_valid()) {
-        return Result<std::pair<std::string, double>>("Failed to create ICMP socket");
+    // The first TTL whose probes reached the destination, or drew an
+    // unreachable from a router on the way; 0 while none has
+    size_t reached() const { return reached_; }
+    
+    // Probes sent to the hop `ttl` away
+    size_t probes(size_t ttl) const { return wanted_[ttl - 1]; }
+    
+    const HopProbe& probe(size_t ttl, size_t query) const {
+        return probes_[index(ttl, query)];
     }
+
+private:
+    size_t index(size_t ttl, size_t query) const { return (ttl - 1) * per_hop_ + query % per_hop_; }
+    size_t ttl_of(size_t k) const { return k / per_hop_ + 1; }
     
-    icmp_sock.set_timeout(2000ms);
+    uint16_t port_of(size_t k) const {
+        switch (config_.mode) {
+            case TraceMode::CLASSIC: return static_cast<uint16_t>(BASE_PORT + k);
+            case TraceMode::PARIS: break;
+            case TraceMode::MDA: return static_cast<uint16_t>(BASE_PORT + k % per_hop_);
+        }
+        return BASE_PORT;
+    }
     
-    auto start = steady_clock::now();
+    // Queue probes for the hop `ttl` away until it has `count`. Only a
+    // continuous trace wraps around its slots; should a slot still be
+    // waiting, its probe is given up for lost.
+    void want(size_t ttl, size_t count) {
+        if (!config_.continuous) count = std::min(count, per_hop_);
+        while (wanted_[ttl - 1] < count) {
+            size_t k = index(ttl, wanted_[ttl - 1]++);
+            if (probes_[k].state == HopProbe::WAITING) complete(k, HopProbe::EXPIRED);
+            probes_[k] = HopProbe{};
+            queue_.push_back(static_cast<uint32_t>(k));
+            ++pending_[ttl - 1];
+        }
+    }
+    
+    void complete(size_t k, uint8_t state) {
+        probes_[k].state = state;
+        --pending_[ttl_of(k) - 1];
+        if (on_complete_) on_complete_(ttl_of(k), probes_[k]);
+    }
+    
+    time_point due(size_t n) const {
+        return start_ + config_.pace * static_cast<int64_t>(n);
+    }
+    
+    void pump() {
+        timer_ = TimerWheel::INVALID_TIMER;
+        auto now = steady_clock::now();
+        
+        // Probes are retired in the order they were sent
+        while (!sent_.empty()) {
+            size_t k = sent_.front();
+            if (probes_[k].state == HopProbe::WAITING) {
+                if (now < probes_[k].sent + config_.timeout) break;
+                complete(k, HopProbe::EXPIRED);
+            }
+            sent_.pop_front();
+        }
+        
+        // Probes past the destination are dropped unsent
+        while (!queue_.empty() && due(sends_) <= now) {
+            size_t k = queue_.front();
+            if (reached_ && ttl_of(k) > reached_) {
+                queue_.pop_front();
+                continue;
+            }
+            if (!send(k)) break;
+            queue_.pop_front();
+            sent_.push_back(static_cast<uint32_t>(k));
+            ++sends_;
+        }
+        
+        if (done()) return;
+        
+        time_point wake = time_point::max();
+        if (!queue_.empty()) {
+            wake = std::max(due(sends_), now + 1ms);
+        }
+        if (!sent_.empty()) {
+            wake = std::min(wake, probes_[sent_.front()].sent + config_.timeout);
+        }
+        timer_ = io_.schedule_at(wake, [this] { pump(); });
+    }
+    
+    // False if the socket buffer is full and the probe should be sent later
+    bool send(size_t k) {
+        sockaddr_in to = dest_;
+        to.sin_port = htons(port_of(k));
+        
+        // The payload: one byte for a classic probe, the checksum pad for
+        // the others
+        ProbeSegment segment{};
+        segment.header.source = port_;
+        segment.header.dest = to.sin_port;
+        segment.header.len = htons(sizeof(segment));
+        iovec iov{&segment.pad, 1};
+        if (config_.mode != TraceMode::CLASSIC) {
+            segment.pad = checksum_pad(source_, dest_.sin_addr.s_addr, segment, static_cast<uint16_t>(k + 1));
+            iov.iov_len = sizeof(segment.pad);
+        }
+        
+        // The TTL rides along with each probe rather than costing a
+        // setsockopt() per probe
+        int ttl = static_cast<int>(ttl_of(k));
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+        msghdr msg{};
+        msg.msg_name = &to;
+        msg.msg_namelen = sizeof(to);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type = IP_TTL;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &ttl, sizeof(ttl));
+        
+        // Under IP_RECVERR an error already queued is also reported by
+        // the next send, which then has not gone out; it is sent again
+        auto sent = steady_clock::now();
+        ssize_t n = -1;
+        for (int attempt = 0; attempt < 2 && n < 0; ++attempt) {
+            n = ::sendmsg(send_.fd(), &msg, MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+                return false;
+            }
+        }
+        
+        // The kernel numbers the sends it stamps
+        if (n >= 0 && stamps_) {
+            stamp_keys_[stamp_count_++ % stamp_keys_.size()] = static_cast<uint32_t>(k);
+        }
+        
+        // Any other error leaves the probe to time out
+        probes_[k].sent = sent;
+        probes_[k].state = HopProbe::WAITING;
+        return true;
+    }
+    
+    void on_event() {
+        size_t queued = queue_.size();
+        drain_error_queue();
+        if (raw_) drain_icmp();
+        
+        if (done()) {
+            io_.cancel(timer_);
+            timer_ = TimerWheel::INVALID_TIMER;
+        } else if (queue_.size() > queued) {
+            // MDA wants more probes; they go out now, not on the next tick
+            io_.cancel(timer_);
+            pump();
+        }
+    }
+    
+    // Send stamps, and the ICMP errors themselves without a raw socket
+    void drain_error_queue() {
+        char buffer[512];
+        alignas(cmsghdr) char control[TIMESTAMP_CONTROL_SIZE];
+        
+        while (true) {
+            sockaddr_in original{};
+            iovec iov{buffer, sizeof(buffer)};
+            msghdr msg{};
+            msg.msg_name = &original;
+            msg.msg_namelen = sizeof(original);
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            ssize_t n = ::recvmsg(send_.fd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+            if (n < 0) break;
+            auto now = steady_clock::now();
+            
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) continue;
+                
+                const auto* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+                if (err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && err->ee_info == SCM_TSTAMP_SND) {
+                    HopProbe& probe = probes_[stamp_keys_[err->ee_data % stamp_keys_.size()]];
+                    if (probe.state != HopProbe::WAITING) continue;
+                    KernelTimestamp stamp = message_timestamp(msg);
+                    if (stamp.software_ns) probe.sent_stamp.software_ns = stamp.software_ns;
+                    if (stamp.hardware_ns) probe.sent_stamp.hardware_ns = stamp.hardware_ns;
+                    continue;
+                }
+                if (err->ee_origin != SO_EE_ORIGIN_ICMP) continue;
+                
+                // The router or host that sent the error
+                sockaddr_in offender{};
+                std::memcpy(&offender, SO_EE_OFFENDER(err), sizeof(offender));
+                on_error(probe_of(original.sin_port, buffer, static_cast<size_t>(n), 0),
+                         err->ee_type, offender.sin_addr, now, message_timestamp(msg));
+            }
+        }
+    }
+    
+    // Errors on the raw socket, matched by the headers they quote
+    void drain_icmp() {
+        uint8_t buffer[1024];
+        alignas(cmsghdr) char control[TIMESTAMP_CONTROL_SIZE];
+        
+        while (true) {
+            sockaddr_in from{};
+            iovec iov{buffer, sizeof(buffer)};
+            msghdr msg{};
+            msg.msg_name = &from;
+            msg.msg_namelen = sizeof(from);
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            ssize_t n = ::recvmsg(recv_.fd(), &msg, MSG_DONTWAIT);
+            if (n < 0) break;
+            auto now = steady_clock::now();
+            
+            // Outer IP header, ICMP header, then the start of our probe
+            size_t outer_len = (buffer[0] & 0x0F) * 4;
+            if (static_cast<size_t>(n) < outer_len + sizeof(icmphdr) + sizeof(iphdr)) continue;
+            
+            const auto* icmp = reinterpret_cast<const icmphdr*>(buffer + outer_len);
+            if (icmp->type != ICMP_TIME_EXCEEDED && icmp->type != ICMP_DEST_UNREACH) continue;
+            
+            const auto* inner = reinterpret_cast<const iphdr*>(buffer + outer_len + sizeof(icmphdr));
+            size_t inner_len = inner->ihl * 4;
+            if (static_cast<size_t>(n) < outer_len + sizeof(icmphdr) + inner_len + sizeof(udphdr)) continue;
+            if (inner->protocol != IPPROTO_UDP || inner->daddr != dest_.sin_addr.s_addr) continue;
+            
+            size_t header_len = outer_len + sizeof(icmphdr) + inner_len + sizeof(udphdr);
+            const auto* udp = reinterpret_cast<const udphdr*>(buffer + header_len - sizeof(udphdr));
+            if (udp->source != port_) continue;
+            
+            on_error(probe_of(udp->dest, buffer + header_len, static_cast<size_t>(n) - header_len, udp->check),
+                     icmp->type, from.sin_addr, now, message_timestamp(msg));
+        }
+    }
     
-    // Send UDP packet to high port
-    char data = 0;
-    auto send_result = sock.sendto(&data, sizeof(data),
-        reinterpret_cast<const sockaddr*>(&dest), sizeof(dest));
+    // The probe an error quotes: by port for a classic probe, otherwise by
+    // the payload where the router quoted it, or else by the checksum (0
+    // where unknown). The payload comes first as NAT rewrites checksums.
+    size_t probe_of(uint16_t port, const void* payload, size_t quoted, uint16_t check) const {
+        if (config_.mode == TraceMode::CLASSIC) {
+            return size_t{ntohs(port)} - BASE_PORT;
+        }
+        if (quoted < sizeof(uint16_t)) {
+            return size_t{ntohs(check)} - 1;
+        }
+        
+        ProbeSegment segment{};
+        segment.header.source = port_;
+        segment.header.dest = port;
+        segment.header.len = htons(sizeof(segment));
+        std::memcpy(&segment.pad, payload, sizeof(segment.pad));
+        return size_t{checksum_id(source_, dest_.sin_addr.s_addr, segment)} - 1;
+    }
     
-    if (!send_result) {
-        return Result<std::pair<std::string, double>>(send_result.error);
+    void on_error(size_t k, uint8_t type, in_addr from, time_point now, const KernelTimestamp& received) {
+        if (k >= probes_.size()) return;
+        
+        HopProbe& probe = probes_[k];
+        if (probe.state != HopProbe::WAITING) return;
+        
+        probe.from = from;
+        probe.rtt = std::chrono::duration<double, std::milli>(now - probe.sent).count();
+        if (auto kernel = kernel_rtt(probe.sent_stamp, received)) {
+            probe.rtt = kernel->ms;
+            probe.source = kernel->source;
+        }
+        
+        size_t ttl = ttl_of(k);
+        if (type == ICMP_DEST_UNREACH && (reached_ == 0 || ttl < reached_)) {
+            reached_ = ttl;
+        }
+        complete(k, HopProbe::ANSWERED);
+        
+        // Enough probes to rule out one interface more than answered so far
+        if (config_.mode == TraceMode::MDA) {
+            std::vector<in_addr_t> seen;
+            for (size_t q = 0; q < wanted_[ttl - 1]; ++q) {
+                const HopProbe& other = probes_[index(ttl, q)];
+                if (other.state == HopProbe::ANSWERED &&
+                    std::find(seen.begin(), seen.end(), other.from.s_addr) == seen.end()) {
+                    seen.push_back(other.from.s_addr);
+                }
+            }
+            if (seen.size() < MDA_MAX_INTERFACES) {
+                want(ttl, mda_probes(seen.size()));
+            }
+        }
     }
     
-    // Wait for ICMP response
-    char buffer[512];
-    sockaddr_in from{};
-    socklen_t fromlen = sizeof(from);
+    AsyncIO& io_;
+    sockaddr_in dest_;
+    const TraceConfig& config_;
+    size_t per_hop_;            // Room for probes per hop
     
-    auto recv_result = icmp_sock.recvfrom(buffer, sizeof(buffer),
-        reinterpret_cast<sockaddr*>(&from), &fromlen);
+    Socket send_;
+    Socket recv_;               // Raw ICMP, where allowed
+    bool raw_ = false;
+    in_addr_t source_ = 0;
+    uint16_t port_ = 0;         // Source port, network order
     
-    auto end = steady_clock::now();
-    auto rtt = std::chrono::duration<double, std::milli>(end - start).count();
+    std::vector<HopProbe> probes_;  // By TTL, then query
+    std::vector<size_t> wanted_;    // Probes queued or sent, by TTL
+    std::vector<size_t> pending_;   // Of those, not yet answered or expired
+    std::deque<uint32_t> queue_;    // Probes to send, in order
+    std::deque<uint32_t> sent_;     // Probes sent and not yet retired, in order
+    size_t sends_ = 0;          // Since start_, for pacing
+    size_t reached_ = 0;
+    Callback on_complete_;
     
-    if (!recv_result) {
-        return Result<std::pair<std::string, double>>("Timeout");
+    // Send stamps: the probe of each stamped send, by its key
+    bool stamps_ = false;
+    std::vector<uint32_t> stamp_keys_;
+    uint32_t stamp_count_ = 0;
+    
+    time_point start_{};
+    AsyncIO::TimerId timer_ = TimerWheel::INVALID_TIMER;
+};
+
+// Each interface a hop answered from, and its round trips
+struct Interface {
+    in_addr addr;
+    Statistics rtts;
+};
+
+std::vector<Interface> interfaces(const Tracer& tracer, size_t ttl) {
+    std::vector<Interface> found;
+    for (size_t q = 0; q < tracer.probes(ttl); ++q) {
+        const HopProbe& probe = tracer.probe(ttl, q);
+        if (probe.state != HopProbe::ANSWERED) continue;
+        
+        auto it = std::find_if(found.begin(), found.end(), [&](const Interface& interface) {
+            return interface.addr.s_addr == probe.from.s_addr;
+        });
+        if (it == found.end()) {
+            found.push_back({probe.from, Statistics()});
+            it = found.end() - 1;
+        }
+        it->rtts.add(probe.rtt);
     }
+    return found;
+}
+
+// Rewrite a table cell in place, in the memory it already has
+template <typename... Args>
+void put(std::string& cell, std::format_string<Args...> fmt, Args&&... args) {
+    cell.clear();
+    std::format_to(std::back_inserter(cell), fmt, std::forward<Args>(args)...);
+}
+
+// A hop as a continuous trace sees it: the last `window` probes, and the
+// address that answered last
+struct HopWindow {
+    RollingWindow rtts;
+    in_addr addr{};
+    size_t sent = 0;            // Probes answered or expired, in all
+};
+
+// Set by SIGINT or SIGTERM, which end a continuous trace with a last report
+volatile std::sig_atomic_t interrupted = 0;
+
+void on_interrupt(int) {
+    interrupted = 1;
+}
+
+// Probe every hop each interval for `rounds` rounds (0: until
+// interrupted), reporting rolling statistics once per round: a table
+// redrawn in place on a terminal, a fresh table per round elsewhere, or a
+// snapshot as a line of JSON.
+int run_continuous(AsyncIO& io, Tracer& tracer, const TraceConfig& config,
+                   const std::string& host, size_t rounds, size_t window, bool json) {
+    std::vector<HopWindow> hops(config.max_hops, HopWindow{RollingWindow(window)});
+    tracer.on_complete([&](size_t ttl, const HopProbe& probe) {
+        HopWindow& hop = hops[ttl - 1];
+        ++hop.sent;
+        if (probe.state == HopProbe::ANSWERED) {
+            hop.rtts.add(probe.rtt);
+            hop.addr = probe.from;
+        } else {
+            hop.rtts.add_loss();
+        }
+    });
+    
+    // Hops on show: up to the destination once found, otherwise one past
+    // the furthest that answered. Rows are only ever added.
+    size_t shown = 1;
+    auto update_shown = [&] {
+        size_t last = tracer.reached();
+        if (last == 0) {
+            for (size_t ttl = config.max_hops; ttl > 0; --ttl) {
+                if (hops[ttl - 1].rtts.received() > 0) {
+                    last = std::min(ttl + 1, config.max_hops);
+                    break;
+                }
+            }
+        }
+        shown = std::max(shown, last);
+    };
+    
+    bool live = !json && ansi::is_tty();
+    ansi::Table table({"Hop", "Address", "Loss", "Sent", "Last", "Avg", "Best", "Worst", "StDev"});
+    std::string frame;
+    size_t frame_lines = 0;
+    
+    auto render = [&] {
+        update_shown();
+        while (table.size() < shown) {
+            table.add_row(std::vector<std::string>(9));
+        }
+        
+        for (size_t ttl = 1; ttl <= shown; ++ttl) {
+            const HopWindow& hop = hops[ttl - 1];
+            const RollingWindow& rtts = hop.rtts;
+            auto& row = table.row(ttl - 1);
+            put(row[0], "{}", ttl);
+            if (rtts.received() == 0) {
+                for (size_t i = 1; i < row.size(); ++i) put(row[i], "*");
+                if (rtts.size() > 0) put(row[2], "{:.1f}%", rtts.loss());
+                put(row[3], "{}", hop.sent);
+                continue;
+            }
+            
+            char addr[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &hop.addr, addr, sizeof(addr));
+            put(row[1], "{}", addr);
+            put(row[2], "{:.1f}%", rtts.loss());
+            put(row[3], "{}", hop.sent);
+            put(row[4], "{:.2f} ms", rtts.last());
+            put(row[5], "{:.2f} ms", rtts.mean());
+            put(row[6], "{:.2f} ms", rtts.min());
+            put(row[7], "{:.2f} ms", rtts.max());
+            put(row[8], "{:.2f} ms", rtts.stddev());
+        }
+        
+        // Back over the last frame, then clear whatever it left below
+        // this one
+        table.render_to(frame);
+        if (!live) {
+            std::cout << frame << "\n" << std::flush;
+            return;
+        }
+        if (frame_lines > 0) std::cout << std::format("\033[{}A\r", frame_lines);
+        std::cout << frame << "\033[J" << std::flush;
+        frame_lines = static_cast<size_t>(std::count(frame.begin(), frame.end(), '\n'));
+    };
+    
+    size_t round = 1;
+    auto snapshot = [&] {
+        update_shown();
+        std::string line = std::format(R"({{"host": "{}", "round": {}, "hops": [)", host, round);
+        for (size_t ttl = 1; ttl <= shown; ++ttl) {
+            const HopWindow& hop = hops[ttl - 1];
+            const RollingWindow& rtts = hop.rtts;
+            if (ttl > 1) line += ", ";
+            if (rtts.received() == 0) {
+                line += std::format(R"({{"ttl": {}, "address": null, "sent": {}, "loss_percent": {:.2f}}})",
+                    ttl, hop.sent, rtts.loss());
+                continue;
+            }
+            line += std::format(R"({{"ttl": {}, "address": "{}", "sent": {}, "loss_percent": {:.2f}, )"
+                R"("rtt_last": {:.2f}, "rtt_avg": {:.2f}, "rtt_best": {:.2f}, "rtt_worst": {:.2f}, "rtt_stddev": {:.2f}}})",
+                ttl, ip_string(hop.addr), hop.sent, rtts.loss(), rtts.last(), rtts.mean(),
+                rtts.min(), rtts.max(), rtts.stddev());
+        }
+        std::cout << line << "]}\n" << std::flush;
+    };
+    
+    auto report = [&] {
+        if (json) {
+            snapshot();
+        } else {
+            render();
+        }
+    };
+    
+    // Each round is reported as the next one goes out, which gives its
+    // probes an interval to come back. The last round, or the one an
+    // interrupt cuts short, is reported once the loop ends instead, so
+    // every round is reported exactly once.
+    time_point next = steady_clock::now() + config.interval;
+    std::function<void()> tick = [&] {
+        if (rounds != 0 && round >= rounds) return;
+        report();
+        ++round;
+        tracer.next_round();
+        next += config.interval;
+        io.schedule_at(next, tick);
+    };
     
-    char addr_str[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &from.sin_addr, addr_str, sizeof(addr_str));
+    interrupted = 0;
+    std::signal(SIGINT, on_interrupt);
+    std::signal(SIGTERM, on_interrupt);
     
-    return std::make_pair(std::string(addr_str), rtt);
+    tracer.start();
+    io.schedule_at(next, tick);
+    while (!interrupted && (rounds == 0 || round < rounds || !tracer.done())) {
+        io.run_once(100ms);
+    }
+    
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    report();
+    return 0;
 }
 
 } // anonymous namespace
@@ -69,6 +755,14 @@ int trace(std::span<const char*> args) {
     parser.add_positional("host", "Target host");
     parser.add_option("max-hops", "m", "Maximum number of hops", "30");
     parser.add_option("queries", "q", "Number of queries per hop", "3");
+    parser.add_option("pace", "z", "Milliseconds between probes (0 = all at once)", "0");
+    parser.add_option("timeout", "t", "Timeout per probe in milliseconds", "2000");
+    parser.add_flag("paris", "P", "Keep every probe on one flow through load balancers");
+    parser.add_flag("mda", "M", "Find every path through load balancers, hop by hop");
+    parser.add_flag("continuous", "C", "Keep probing every hop, with rolling statistics");
+    parser.add_option("interval", "i", "Seconds between rounds with --continuous", "1");
+    parser.add_option("count", "c", "Rounds with --continuous (0 = until interrupted)", "0");
+    parser.add_option("window", "w", "Probes per hop in the rolling statistics", "100");
     parser.add_flag("json", "j", "Output in JSON format");
     
     auto parse_result = parser.parse(args);
@@ -84,12 +778,63 @@ int trace(std::span<const char*> args) {
     }
     
     std::string host = positional[0];
-    size_t max_hops = parser.get_as<size_t>("max-hops").value_or(30);
-    size_t queries = parser.get_as<size_t>("queries").value_or(3);
+    TraceConfig config;
+    config.max_hops = parser.get_as<size_t>("max-hops").value_or(30);
+    config.queries = parser.get_as<size_t>("queries").value_or(3);
+    double pace = parser.get_as<double>("pace").value_or(0);
+    config.timeout = std::chrono::milliseconds(parser.get_as<size_t>("timeout").value_or(2000));
     bool json = parser.get_flag("json");
     
+    if (parser.get_flag("paris") && parser.get_flag("mda")) {
+        std::cerr << ansi::error("--paris and --mda cannot be combined") << "\n";
+        return 1;
+    }
+    if (parser.get_flag("paris")) config.mode = TraceMode::PARIS;
+    if (parser.get_flag("mda")) config.mode = TraceMode::MDA;
+    
+    config.continuous = parser.get_flag("continuous");
+    double interval = parser.get_as<double>("interval").value_or(1);
+    size_t rounds = parser.get_as<size_t>("count").value_or(0);
+    size_t window = parser.get_as<size_t>("window").value_or(RollingWindow::DEFAULT_CAPACITY);
+    if (config.continuous && config.mode == TraceMode::MDA) {
+        std::cerr << ansi::error("--continuous and --mda cannot be combined") << "\n";
+        return 1;
+    }
+    if (!(interval >= 0.01)) {
+        std::cerr << ansi::error("Interval must be at least 0.01 seconds") << "\n";
+        return 1;
+    }
+    if (window == 0) {
+        std::cerr << ansi::error("Window must be at least 1 probe") << "\n";
+        return 1;
+    }
+    config.interval = std::chrono::duration_cast<duration>(std::chrono::duration<double>(interval));
+    
+    if (config.max_hops == 0 || config.max_hops > 255) {
+        std::cerr << ansi::error("Max hops must be between 1 and 255") << "\n";
+        return 1;
+    }
+    if (config.queries == 0 || config.queries > 10) {
+        std::cerr << ansi::error("Queries must be between 1 and 10") << "\n";
+        return 1;
+    }
+    if (!(pace >= 0)) {
+        std::cerr << ansi::error("Pace must not be negative") << "\n";
+        return 1;
+    }
+    config.pace = std::chrono::duration_cast<duration>(std::chrono::duration<double, std::milli>(pace));
+    
+    // Probe ids are classic ports above BASE_PORT, or checksums other than 0
+    size_t slots = config.max_hops * slots_per_hop(config);
+    size_t limit = config.mode == TraceMode::CLASSIC ? size_t{65536 - BASE_PORT} : size_t{65535};
+    if (slots > limit) {
+        std::cerr << ansi::error(std::format("{} probes in flight is more than there are ids for; "
+            "lengthen the interval or lower the timeout, queries or max hops", slots)) << "\n";
+        return 1;
+    }
+    
     // Resolve destination
-    auto addr_result = Socket::resolve(host, 33434); // Standard traceroute port
+    auto addr_result = Socket::resolve(host, BASE_PORT);
     if (!addr_result) {
         std::cerr << ansi::error(std::format("Failed to resolve {}: {}",
             host, addr_result.error)) << "\n";
@@ -98,69 +843,145 @@ int trace(std::span<const char*> args) {
     
     auto& dest = *addr_result;
     
+    AsyncIO io;
+    Tracer tracer(io, dest, config);
+    if (auto res = tracer.open(); !res) {
+        std::cerr << ansi::error(res.error) << "\n";
+        return 1;
+    }
+    
     if (!json) {
         std::cout << ansi::info(std::format("traceroute to {} ({}), {} hops max",
             host, Socket::addr_to_string(dest).substr(0, Socket::addr_to_string(dest).find(':')),
-            max_hops)) << "\n\n";
+            config.max_hops)) << "\n\n";
     }
     
-    ansi::Table table({"Hop", "Address", "RTT 1", "RTT 2", "RTT 3", "Avg"});
+    if (config.continuous) {
+        return run_continuous(io, tracer, config, host, rounds, window, json);
+    }
     
-    for (size_t ttl = 1; ttl <= max_hops; ++ttl) {
-        std::vector<double> rtts;
-        std::string hop_addr = "*";
-        
-        for (size_t q = 0; q < queries; ++q) {
-            auto probe_result = probe_hop(dest, ttl);
-            
-            if (probe_result) {
-                auto [addr, rtt] = *probe_result;
-                hop_addr = addr;
-                rtts.push_back(rtt);
+    tracer.start();
+    while (!tracer.done()) {
+        io.run_once(100ms);
+    }
+    
+    // MDA lists each interface of a hop with its own statistics; the
+    // other modes a column per query
+    bool mda = config.mode == TraceMode::MDA;
+    std::vector<std::string> headers = {"Hop", "Address"};
+    if (mda) {
+        headers.insert(headers.end(), {"Replies", "Min", "Avg", "Max"});
+    } else {
+        for (size_t q = 0; q < config.queries; ++q) {
+            headers.push_back(std::format("RTT {}", q + 1));
+        }
+        headers.push_back("Avg");
+    }
+    ansi::Table table(headers);
+    std::string hops;           // The JSON of each hop, one per line
+    std::array<size_t, 3> sources{};
+    
+    for (size_t ttl = 1; ttl <= config.max_hops; ++ttl) {
+        auto found = interfaces(tracer, ttl);
+        for (size_t q = 0; q < tracer.probes(ttl); ++q) {
+            const HopProbe& probe = tracer.probe(ttl, q);
+            if (probe.state == HopProbe::ANSWERED) {
+                ++sources[static_cast<size_t>(probe.source)];
             }
-            
-            std::this_thread::sleep_for(100ms);
         }
         
-        if (!json) {
-            std::vector<std::string> row;
-            row.push_back(std::format("{}", ttl));
-            row.push_back(hop_addr);
+        if (json) {
+            // Every interface with its own statistics, in all modes
+            std::string list;
+            for (const auto& interface : found) {
+                const Statistics& rtts = interface.rtts;
+                if (!list.empty()) list += ", ";
+                list += std::format(R"({{"address": "{}", "replies": {}, )"
+                    R"("rtt_min": {:.2f}, "rtt_avg": {:.2f}, "rtt_max": {:.2f}}})",
+                    ip_string(interface.addr), rtts.count(), rtts.min(), rtts.mean(), rtts.max());
+            }
+            if (!hops.empty()) hops += ",\n";
+            hops += std::format(R"(    {{"ttl": {}, "probes": {}, "interfaces": [{}]}})",
+                ttl, tracer.probes(ttl), list);
+        } else if (found.empty()) {
+            std::vector<std::string> row(headers.size(), "*");
+            row[0] = std::format("{}", ttl);
+            table.add_row(row);
+        } else if (mda) {
+            for (size_t i = 0; i < found.size(); ++i) {
+                const Statistics& rtts = found[i].rtts;
+                table.add_row({
+                    i == 0 ? std::format("{}", ttl) : "",
+                    ip_string(found[i].addr),
+                    std::format("{}/{}", rtts.count(), tracer.probes(ttl)),
+                    std::format("{:.2f} ms", rtts.min()),
+                    std::format("{:.2f} ms", rtts.mean()),
+                    std::format("{:.2f} ms", rtts.max())
+                });
+            }
+        } else {
+            // Queries that took different paths show every address
+            std::string addresses;
+            for (const auto& interface : found) {
+                if (!addresses.empty()) addresses += ", ";
+                addresses += ip_string(interface.addr);
+            }
             
-            for (size_t i = 0; i < queries; ++i) {
-                if (i < rtts.size()) {
-                    row.push_back(std::format("{:.2f} ms", rtts[i]));
+            std::vector<std::string> row = {std::format("{}", ttl), addresses};
+            double total = 0;
+            size_t answered = 0;
+            for (size_t q = 0; q < config.queries; ++q) {
+                const HopProbe& probe = tracer.probe(ttl, q);
+                if (probe.state == HopProbe::ANSWERED) {
+                    row.push_back(std::format("{:.2f} ms", probe.rtt));
+                    total += probe.rtt;
+                    ++answered;
                 } else {
                     row.push_back("*");
                 }
             }
-            
-            if (!rtts.empty()) {
-                double avg = std::accumulate(rtts.begin(), rtts.end(), 0.0) / rtts.size();
-                row.push_back(std::format("{:.2f} ms", avg));
-            } else {
-                row.push_back("*");
-            }
-            
+            row.push_back(std::format("{:.2f} ms", total / answered));
             table.add_row(row);
         }
         
-        // Check if we reached destination
-        char dest_str[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &dest.sin_addr, dest_str, sizeof(dest_str));
-        
-        if (hop_addr == dest_str) {
+        if (ttl == tracer.reached()) {
             break;
         }
         
-        if (hop_addr == "*" && ttl > 10) {
+        if (found.empty() && ttl > 10) {
             // Too many failed hops, likely unreachable
             break;
         }
     }
     
-    if (!json) {
+    // The source most RTTs came from, if any hop answered
+    size_t best = sources.size() - 1;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i] > sources[best]) best = i;
+    }
+    const char* rtt_source = sources[best] > 0
+        ? timestamp_source_name(static_cast<TimestampSource>(best)) : nullptr;
+    
+    if (json) {
+        static constexpr const char* MODES[] = {"classic", "paris", "mda"};
+        std::cout << std::format(R"({{
+  "host": "{}",
+  "destination": "{}",
+  "mode": "{}",
+  "reached": {},
+  "rtt_source": {},
+  "hops": [
+{}
+  ]
+}})" "\n",
+            host, ip_string(dest.sin_addr), MODES[static_cast<size_t>(config.mode)],
+            tracer.reached() != 0,
+            rtt_source ? std::format("\"{}\"", rtt_source) : std::string("null"), hops);
+    } else {
         std::cout << table.render();
+        if (rtt_source) {
+            std::cout << std::format("\nrtt source: {} timestamps\n", rtt_source);
+        }
     }
     
     return 0;
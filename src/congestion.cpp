@@ -0,0 +1,151 @@
+#include "congestion.h"
+#include <algorithm>
+#include <cmath>
+
+namespace netprobe {
+
+namespace {
+
+// How often the measured send rate is refreshed
+constexpr auto RATE_INTERVAL = 250ms;
+
+// Token buckets hold up to 10ms worth of sends
+constexpr double BURST_SECONDS = 0.01;
+
+double seconds(duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+size_t slot_of(in_addr_t addr, size_t mask) {
+    uint32_t x = addr * 0x9E3779B1u;
+    return (x ^ (x >> 16)) & mask;
+}
+
+} // anonymous namespace
+
+// RttTable implementation
+RttTable::RttTable(size_t slots) {
+    size_t size = 1;
+    while (size < slots) size *= 2;
+    entries_.resize(size);
+    mask_ = size - 1;
+}
+
+void RttTable::sample(in_addr_t addr, duration rtt) {
+    Entry& entry = entries_[slot_of(addr, mask_)];
+    double r = seconds(rtt);
+    
+    if (!entry.valid || entry.addr != addr) {
+        entry = {addr, true, r, r / 2};
+        return;
+    }
+    entry.rttvar = 0.75 * entry.rttvar + 0.25 * std::abs(entry.srtt - r);
+    entry.srtt = 0.875 * entry.srtt + 0.125 * r;
+}
+
+const RttTable::Entry* RttTable::find(in_addr_t addr) const {
+    const Entry& entry = entries_[slot_of(addr, mask_)];
+    return entry.valid && entry.addr == addr ? &entry : nullptr;
+}
+
+bool RttTable::known(in_addr_t addr) const {
+    return find(addr) != nullptr;
+}
+
+duration RttTable::timeout(in_addr_t addr, duration floor, duration ceiling) const {
+    const Entry* entry = find(addr);
+    if (!entry) return ceiling;
+    
+    auto rto = std::chrono::duration_cast<duration>(
+        std::chrono::duration<double>(entry->srtt + 4 * entry->rttvar));
+    return std::clamp(rto, std::min(floor, ceiling), ceiling);
+}
+
+// CongestionControl implementation
+CongestionControl::CongestionControl(Limits limits)
+    : limits_(limits),
+      window_(static_cast<double>(std::clamp<size_t>(limits.initial_window, 1, limits.max_window))),
+      ssthresh_(static_cast<double>(limits.max_window)) {
+    publish();
+}
+
+void CongestionControl::refill(time_point now) {
+    if (last_refill_ == time_point{}) {
+        last_refill_ = now;
+        rate_since_ = now;
+        max_tokens_ = std::max(limits_.max_rate * BURST_SECONDS, 1.0);
+        return;
+    }
+    
+    double elapsed = seconds(now - last_refill_);
+    last_refill_ = now;
+    if (limits_.max_rate > 0) {
+        max_tokens_ = std::min(max_tokens_ + elapsed * limits_.max_rate,
+                               std::max(limits_.max_rate * BURST_SECONDS, 1.0));
+    }
+    if (limits_.min_rate > 0) {
+        min_credit_ = std::min(min_credit_ + elapsed * limits_.min_rate,
+                               std::max(limits_.min_rate * BURST_SECONDS, 1.0));
+    }
+    
+    if (now - rate_since_ >= RATE_INTERVAL) {
+        double measured = sent_ / seconds(now - rate_since_);
+        rate_ = rate_ > 0 ? (rate_ + measured) / 2 : measured;
+        sent_ = 0;
+        rate_since_ = now;
+        publish();
+    }
+}
+
+bool CongestionControl::try_send(time_point now, size_t in_flight) {
+    refill(now);
+    in_flight_ = in_flight;
+    
+    bool window_open = static_cast<double>(in_flight) < window_ || min_credit_ >= 1;
+    bool under_cap = limits_.max_rate <= 0 || max_tokens_ >= 1;
+    if (!window_open || !under_cap) return false;
+    
+    if (limits_.max_rate > 0) max_tokens_ -= 1;
+    min_credit_ = std::max(min_credit_ - 1, 0.0);
+    ++sent_;
+    return true;
+}
+
+bool CongestionControl::try_resend(time_point now) {
+    refill(now);
+    if (limits_.max_rate > 0) {
+        if (max_tokens_ < 1) return false;
+        max_tokens_ -= 1;
+    }
+    ++sent_;
+    return true;
+}
+
+void CongestionControl::on_reply() {
+    // A window the scan is not filling, held back by the rate cap or out
+    // of probes, has not been shown to be safe and does not grow
+    if (static_cast<double>(in_flight_) < window_ / 2) return;
+    
+    window_ += window_ < ssthresh_ ? 1.0 : 1.0 / window_;
+    window_ = std::min(window_, static_cast<double>(limits_.max_window));
+}
+
+void CongestionControl::on_silence() {
+    on_reply();
+}
+
+void CongestionControl::on_loss(time_point sent, time_point now) {
+    if (sent < last_decrease_) return;
+    
+    ssthresh_ = std::max(window_ / 2, 2.0);
+    window_ = std::max(window_ / 2, 1.0);
+    last_decrease_ = now;
+    publish();
+}
+
+void CongestionControl::publish() {
+    window_view_.store(window_, std::memory_order_relaxed);
+    rate_view_.store(rate_, std::memory_order_relaxed);
+}
+
+} // namespace netprobe
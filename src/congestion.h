@@ -0,0 +1,105 @@
+#pragma once
+
+#include "common.h"
+#include <netinet/in.h>
+#include <atomic>
+#include <vector>
+
+namespace netprobe {
+
+// Round-trip estimates per target, smoothed as in RFC 6298.
+//
+// Kept in a fixed table indexed by a hash of the address, so a sweep of a
+// large block uses the same memory as one host; a target whose slot was
+// taken over by another simply reads as unknown again.
+class RttTable {
+public:
+    explicit RttTable(size_t slots = 4096);
+    
+    void sample(in_addr_t addr, duration rtt);
+    
+    // True once `addr` has answered at least once
+    bool known(in_addr_t addr) const;
+    
+    // srtt + 4 * rttvar for a known target, clamped to [floor, ceiling];
+    // `ceiling` for one that has never answered
+    duration timeout(in_addr_t addr, duration floor, duration ceiling) const;
+
+private:
+    struct Entry {
+        in_addr_t addr = 0;
+        bool valid = false;
+        double srtt = 0;        // Seconds
+        double rttvar = 0;
+    };
+    
+    const Entry* find(in_addr_t addr) const;
+    
+    std::vector<Entry> entries_;
+    size_t mask_;
+};
+
+// AIMD congestion control for probes that expect a reply.
+//
+// The window bounds the probes awaiting a reply: it grows by one per
+// completed probe in slow start and by one per window of them after that,
+// and halves when a probe is lost. A loss needs evidence, such as a retry
+// answered where the first attempt was not; plain silence (a filtered port,
+// a dead address) says nothing about congestion and counts as completed.
+// Losses of probes sent before the last decrease belong to the same
+// congestion event and are not counted again.
+//
+// On top of the window, a token bucket holds the send rate under
+// `max_rate`, and a second one lets probes past a full window so the rate
+// never falls under `min_rate`. Each instance belongs to one reactor.
+class CongestionControl {
+public:
+    struct Limits {
+        double min_rate = 0;            // Probes/sec, 0: no floor
+        double max_rate = 0;            // Probes/sec, 0: no cap
+        size_t max_window = 4096;
+        size_t initial_window = 64;
+    };
+    
+    explicit CongestionControl(Limits limits);
+    
+    // Whether one more probe may go out now, taking its send credit if
+    // so. `in_flight` counts the probes already awaiting a reply.
+    bool try_send(time_point now, size_t in_flight);
+    
+    // Whether a probe already in flight may be sent again now; only the
+    // rate cap applies
+    bool try_resend(time_point now);
+    
+    void on_reply();
+    void on_silence();
+    void on_loss(time_point sent, time_point now);
+    
+    // Safe to call from any thread
+    double window() const { return window_view_.load(std::memory_order_relaxed); }
+    double rate() const { return rate_view_.load(std::memory_order_relaxed); }
+
+private:
+    void refill(time_point now);
+    void publish();
+    
+    Limits limits_;
+    double window_;
+    double ssthresh_;
+    size_t in_flight_ = 0;              // As of the last try_send()
+    time_point last_decrease_{};
+    
+    double max_tokens_ = 0;             // Sends allowed by max_rate
+    double min_credit_ = 0;             // Sends owed to reach min_rate
+    time_point last_refill_{};
+    
+    // Measured send rate, updated every RATE_INTERVAL
+    uint64_t sent_ = 0;
+    time_point rate_since_{};
+    double rate_ = 0;
+    
+    std::atomic<double> window_view_{0};
+    std::atomic<double> rate_view_{0};
+};
+
+} // namespace netprobe
@@ -0,0 +1,189 @@
+#include "coro.h"
+#include <array>
+#include <cstring>
+#include <new>
+
+namespace netprobe {
+
+namespace {
+
+// Frames are pooled in 64-byte size classes up to 4KB; bigger ones go
+// straight to the allocator
+constexpr size_t GRANULE = 64;
+constexpr size_t MAX_POOLED_SIZE = 4096;
+constexpr size_t SIZE_CLASSES = MAX_POOLED_SIZE / GRANULE;
+
+// Bounds what an idle thread keeps cached per size class
+constexpr size_t MAX_CACHED = 16384;
+
+struct FreeFrame {
+    FreeFrame* next;
+};
+
+struct FrameCache {
+    std::array<FreeFrame*, SIZE_CLASSES> heads{};
+    std::array<size_t, SIZE_CLASSES> counts{};
+    
+    ~FrameCache();
+};
+
+// Frames freed during thread teardown, after the cache is gone, bypass it
+thread_local bool cache_destroyed = false;
+thread_local FrameCache cache;
+
+FrameCache::~FrameCache() {
+    for (auto* head : heads) {
+        while (head) {
+            auto* next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+    cache_destroyed = true;
+}
+
+size_t size_class(size_t size) {
+    return (size + GRANULE - 1) / GRANULE - 1;
+}
+
+} // anonymous namespace
+
+void* FramePool::allocate(size_t size) {
+    if (size > MAX_POOLED_SIZE || cache_destroyed) {
+        return ::operator new(size);
+    }
+    
+    size_t cls = size_class(size);
+    if (auto* frame = cache.heads[cls]) {
+        cache.heads[cls] = frame->next;
+        --cache.counts[cls];
+        return frame;
+    }
+    return ::operator new((cls + 1) * GRANULE);
+}
+
+void FramePool::deallocate(void* ptr, size_t size) {
+    if (size > MAX_POOLED_SIZE || cache_destroyed) {
+        ::operator delete(ptr);
+        return;
+    }
+    
+    size_t cls = size_class(size);
+    if (cache.counts[cls] >= MAX_CACHED) {
+        ::operator delete(ptr);
+        return;
+    }
+    
+    auto* frame = static_cast<FreeFrame*>(ptr);
+    frame->next = cache.heads[cls];
+    cache.heads[cls] = frame;
+    ++cache.counts[cls];
+}
+
+std::string IoResult::message() const {
+    return error == ETIMEDOUT ? "Timed out" : std::strerror(error);
+}
+
+AsyncSocket::AsyncSocket(AsyncIO& io, Socket sock) : io_(io), sock_(std::move(sock)) {
+    if (sock_.is_valid()) {
+        sock_.set_nonblocking(true);
+    }
+}
+
+AsyncSocket::~AsyncSocket() {
+    if (registered_) {
+        io_.remove(sock_.fd());
+    }
+}
+
+Socket AsyncSocket::release() {
+    if (registered_) {
+        io_.remove(sock_.fd());
+        registered_ = false;
+        interest_ = 0;
+    }
+    return std::move(sock_);
+}
+
+bool AsyncSocket::wait(Direction dir, Waiter& waiter, duration timeout) {
+    int needed = interest_ | static_cast<int>(
+        dir == Direction::READ ? AsyncIO::Event::READ : AsyncIO::Event::WRITE);
+    
+    if (!registered_) {
+        auto res = io_.add(sock_.fd(), static_cast<AsyncIO::Event>(needed),
+            [this](int, AsyncIO::Event event) { on_event(event); });
+        if (!res) {
+            waiter.error = sock_.is_valid() ? EINVAL : EBADF;
+            return false;
+        }
+        registered_ = true;
+    } else if (needed != interest_) {
+        io_.modify(sock_.fd(), static_cast<AsyncIO::Event>(needed));
+    }
+    interest_ = needed;
+    
+    slot(dir) = &waiter;
+    if (timeout != NO_TIMEOUT) {
+        waiter.timer = io_.schedule(timeout, [this, &waiter]() {
+            waiter.timer = TimerWheel::INVALID_TIMER;
+            waiter.error = ETIMEDOUT;
+            resume(waiter);
+        });
+    }
+    return true;
+}
+
+void AsyncSocket::cancel_wait(Direction dir, Waiter& waiter) {
+    if (slot(dir) == &waiter) {
+        slot(dir) = nullptr;
+    }
+    io_.cancel(waiter.timer);
+    waiter.timer = TimerWheel::INVALID_TIMER;
+}
+
+void AsyncSocket::on_event(AsyncIO::Event event) {
+    // On error, whichever operation is waiting retries and reports it
+    Waiter* waiter = nullptr;
+    if (event == AsyncIO::Event::READ) {
+        waiter = reader_;
+    } else if (event == AsyncIO::Event::WRITE) {
+        waiter = writer_;
+    } else {
+        waiter = reader_ ? reader_ : writer_;
+    }
+    
+    if (!waiter) {
+        update_interest();
+        return;
+    }
+    
+    if (waiter->attempt(waiter->self)) {
+        resume(*waiter);
+    }
+}
+
+// Drop interest no waiter needs, so a level-triggered fd stops firing
+void AsyncSocket::update_interest() {
+    int needed = (reader_ ? static_cast<int>(AsyncIO::Event::READ) : 0) |
+                 (writer_ ? static_cast<int>(AsyncIO::Event::WRITE) : 0);
+    
+    if (needed == 0) {
+        io_.remove(sock_.fd());
+        registered_ = false;
+    } else if (needed != interest_) {
+        io_.modify(sock_.fd(), static_cast<AsyncIO::Event>(needed));
+    }
+    interest_ = needed;
+}
+
+void AsyncSocket::resume(Waiter& waiter) {
+    if (reader_ == &waiter) reader_ = nullptr;
+    if (writer_ == &waiter) writer_ = nullptr;
+    io_.cancel(waiter.timer);
+    waiter.timer = TimerWheel::INVALID_TIMER;
+    
+    // Last: the coroutine may destroy this socket before returning
+    waiter.handle.resume();
+}
+
+} // namespace netprobe
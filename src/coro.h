@@ -0,0 +1,384 @@
+#pragma once
+
+#include "common.h"
+#include "async_io.h"
+#include "socket.h"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace netprobe {
+
+// C++20 coroutines over AsyncIO.
+//
+// Probe logic is written as sequential code that co_awaits socket
+// operations and sleeps; each suspension parks the coroutine on the event
+// loop, so one thread can run thousands of probes at once:
+//
+//     Task<void> probe(AsyncIO& io, sockaddr_in addr) {
+//         AsyncSocket sock(io, Socket(Socket::Type::TCP));
+//         auto res = co_await sock.connect(addr, 500ms);
+//         ...
+//     }
+//
+//     spawn(probe(io, addr));     // fire and forget
+//     io.run();
+
+// Coroutine frames are recycled through per-thread free lists, so
+// starting a probe does not call malloc once the pool is warm
+class FramePool {
+public:
+    static void* allocate(size_t size);
+    static void deallocate(void* ptr, size_t size);
+};
+
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+    bool detached = false;
+    
+    static void* operator new(size_t size) { return FramePool::allocate(size); }
+    static void operator delete(void* ptr, size_t size) { FramePool::deallocate(ptr, size); }
+    
+    // Tasks are lazy: nothing runs until awaited or started
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    
+    // Hand control straight back to the awaiting coroutine; a detached
+    // task frees itself
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            auto& promise = handle.promise();
+            if (promise.detached) {
+                if (promise.exception) std::terminate();
+                handle.destroy();
+                return std::noop_coroutine();
+            }
+            return promise.continuation ? promise.continuation : std::noop_coroutine();
+        }
+        
+        void await_resume() noexcept {}
+    };
+    
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+    
+    Task<T> get_return_object();
+    
+    template<typename U>
+    void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+    
+    T result() {
+        if (exception) std::rethrow_exception(exception);
+        return std::move(*value);
+    }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    
+    void result() {
+        if (exception) std::rethrow_exception(exception);
+    }
+};
+
+} // namespace detail
+
+// Lazily started coroutine producing a T. Await it from another coroutine,
+// spawn() it, or drive it with run_until_complete(); each task runs once.
+template<typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+    
+    Task() = default;
+    explicit Task(Handle handle) : handle_(handle) {}
+    
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    
+    ~Task() { reset(); }
+    
+    bool done() const { return !handle_ || handle_.done(); }
+    
+    // Run until the first suspension
+    void start() { handle_.resume(); }
+    
+    T result() { return handle_.promise().result(); }
+    
+    // Give up ownership; the frame is then freed by whoever holds the handle
+    Handle release() { return std::exchange(handle_, {}); }
+    
+    // Awaiting starts the task; the awaiter resumes when it finishes
+    bool await_ready() const noexcept { return done(); }
+    
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle_.promise().continuation = awaiter;
+        return handle_;
+    }
+    
+    T await_resume() { return result(); }
+
+private:
+    void reset() {
+        if (handle_) {
+            handle_.destroy();
+            handle_ = {};
+        }
+    }
+    
+    Handle handle_;
+};
+
+namespace detail {
+
+template<typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+} // namespace detail
+
+// Start a task that owns itself and frees its frame when it finishes
+inline void spawn(Task<void> task) {
+    auto handle = task.release();
+    handle.promise().detached = true;
+    handle.resume();
+}
+
+// Drive the loop until `task` finishes and return its result
+template<typename T>
+T run_until_complete(AsyncIO& io, Task<T> task) {
+    task.start();
+    while (!task.done()) {
+        io.run_once();
+    }
+    return task.result();
+}
+
+// Wait that never times out
+inline constexpr duration NO_TIMEOUT = duration::max();
+
+// Outcome of an awaitable socket operation: an errno value (ETIMEDOUT
+// when the operation's timeout fired) and the bytes transferred
+struct IoResult {
+    int error = 0;
+    size_t bytes = 0;
+    
+    explicit operator bool() const { return error == 0; }
+    std::string message() const;
+};
+
+// Suspends the coroutine for `delay` on the loop's timer wheel
+class SleepAwaiter {
+public:
+    SleepAwaiter(AsyncIO& io, duration delay) : io_(io), delay_(delay) {}
+    SleepAwaiter(const SleepAwaiter&) = delete;
+    SleepAwaiter& operator=(const SleepAwaiter&) = delete;
+    ~SleepAwaiter() { io_.cancel(timer_); }
+    
+    bool await_ready() const noexcept { return delay_ <= duration::zero(); }
+    
+    void await_suspend(std::coroutine_handle<> handle) {
+        timer_ = io_.schedule(delay_, [this, handle] {
+            timer_ = TimerWheel::INVALID_TIMER;
+            handle.resume();
+        });
+    }
+    
+    void await_resume() noexcept {}
+
+private:
+    AsyncIO& io_;
+    duration delay_;
+    AsyncIO::TimerId timer_ = TimerWheel::INVALID_TIMER;
+};
+
+inline SleepAwaiter sleep_for(AsyncIO& io, duration delay) {
+    return SleepAwaiter(io, delay);
+}
+
+// A non-blocking socket driven by an AsyncIO loop.
+//
+// Every operation tries its syscall first and only suspends on EAGAIN;
+// the coroutine is resumed once the retried syscall completes or the
+// timeout fires. One reader and one writer may be waiting at a time. The
+// fd is registered with the loop on the first wait and keeps its
+// registration between operations; interest that no waiter needs any
+// more is dropped lazily, when it next produces an event.
+class AsyncSocket {
+public:
+    AsyncSocket(AsyncIO& io, Socket sock);
+    ~AsyncSocket();
+    
+    // Registered with the loop by address
+    AsyncSocket(const AsyncSocket&) = delete;
+    AsyncSocket& operator=(const AsyncSocket&) = delete;
+    
+    Socket& socket() { return sock_; }
+    int fd() const { return sock_.fd(); }
+    
+    // Take the socket back, unregistered from the loop, to hand it to
+    // another AsyncSocket; no operation may be waiting on it
+    Socket release();
+    
+    // A parked operation, owned by the awaiter in the coroutine frame
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        bool (*attempt)(void* self) = nullptr;  // False while it would block
+        void* self = nullptr;
+        AsyncIO::TimerId timer = TimerWheel::INVALID_TIMER;
+        int error = 0;      // ETIMEDOUT, or why the fd could not be watched
+    };
+    
+    enum class Direction {
+        READ,
+        WRITE
+    };
+    
+    // Awaiter for one retryable syscall. `Op` returns the syscall result,
+    // leaving errno set on failure.
+    template<typename Op>
+    class Operation {
+    public:
+        Operation(AsyncSocket& sock, Direction dir, duration timeout, Op op)
+            : sock_(sock), dir_(dir), timeout_(timeout), op_(std::move(op)) {}
+        Operation(const Operation&) = delete;
+        Operation& operator=(const Operation&) = delete;
+        ~Operation() { sock_.cancel_wait(dir_, waiter_); }
+        
+        bool await_ready() { return attempt(); }
+        
+        bool await_suspend(std::coroutine_handle<> handle) {
+            waiter_.handle = handle;
+            waiter_.attempt = [](void* self) { return static_cast<Operation*>(self)->attempt(); };
+            waiter_.self = this;
+            return sock_.wait(dir_, waiter_, timeout_);
+        }
+        
+        IoResult await_resume() {
+            return waiter_.error ? IoResult{waiter_.error, 0} : result_;
+        }
+    
+    private:
+        bool attempt() {
+            ssize_t n = op_();
+            if (n >= 0) {
+                result_ = {0, static_cast<size_t>(n)};
+                return true;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return false;
+            }
+            result_ = {errno, 0};
+            return true;
+        }
+        
+        AsyncSocket& sock_;
+        Direction dir_;
+        duration timeout_;
+        Op op_;
+        Waiter waiter_;
+        IoResult result_;
+    };
+    
+    // Connect; completes once the handshake does (or fails)
+    auto connect(const sockaddr_in& addr, duration timeout = NO_TIMEOUT) {
+        return make_operation(Direction::WRITE, timeout, [this, addr, started = false]() mutable -> ssize_t {
+            if (!started) {
+                started = true;
+                if (::connect(fd(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+                    return 0;
+                }
+                if (errno == EINPROGRESS) errno = EAGAIN;
+                return -1;
+            }
+            
+            // Writable: the handshake finished one way or the other
+            int err = sock_.pending_error();
+            if (err == 0) return 0;
+            errno = err;
+            return -1;
+        });
+    }
+    
+    auto recv(void* buffer, size_t len, duration timeout = NO_TIMEOUT) {
+        return make_operation(Direction::READ, timeout, [this, buffer, len]() {
+            return ::recv(fd(), buffer, len, MSG_DONTWAIT);
+        });
+    }
+    
+    auto send(const void* data, size_t len, duration timeout = NO_TIMEOUT) {
+        return make_operation(Direction::WRITE, timeout, [this, data, len]() {
+            return ::send(fd(), data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        });
+    }
+    
+    auto sendto(const void* data, size_t len, const sockaddr_in& to,
+                duration timeout = NO_TIMEOUT) {
+        return make_operation(Direction::WRITE, timeout, [this, data, len, to]() {
+            return ::sendto(fd(), data, len, MSG_DONTWAIT | MSG_NOSIGNAL,
+                reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+        });
+    }
+    
+    auto recvfrom(void* buffer, size_t len, sockaddr_in& from,
+                  duration timeout = NO_TIMEOUT) {
+        return make_operation(Direction::READ, timeout, [this, buffer, len, &from]() {
+            socklen_t from_len = sizeof(from);
+            return ::recvfrom(fd(), buffer, len, MSG_DONTWAIT,
+                reinterpret_cast<sockaddr*>(&from), &from_len);
+        });
+    }
+
+private:
+    template<typename Op>
+    Operation<Op> make_operation(Direction dir, duration timeout, Op op) {
+        return Operation<Op>(*this, dir, timeout, std::move(op));
+    }
+    
+    // Park `waiter`; false if the fd cannot be watched (waiter.error set)
+    bool wait(Direction dir, Waiter& waiter, duration timeout);
+    void cancel_wait(Direction dir, Waiter& waiter);
+    void on_event(AsyncIO::Event event);
+    void update_interest();
+    void resume(Waiter& waiter);
+    
+    Waiter*& slot(Direction dir) { return dir == Direction::READ ? reader_ : writer_; }
+    
+    AsyncIO& io_;
+    Socket sock_;
+    Waiter* reader_ = nullptr;
+    Waiter* writer_ = nullptr;
+    bool registered_ = false;
+    int interest_ = 0;
+};
+
+} // namespace netprobe
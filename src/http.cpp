@@ -0,0 +1,227 @@
+#include "http.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <format>
+
+namespace netprobe {
+
+namespace {
+
+constexpr size_t MAX_LINE_LENGTH = 8192;
+
+bool iequals(std::string_view a, std::string_view b) {
+    return std::ranges::equal(a, b, [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) ==
+               std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) s.remove_suffix(1);
+    return s;
+}
+
+bool contains_token(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        auto comma = value.find(',');
+        if (iequals(trim(value.substr(0, comma)), token)) return true;
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+} // anonymous namespace
+
+size_t HttpResponseParser::feed(const char* data, size_t len) {
+    size_t pos = 0;
+    
+    while (pos < len && status_ == Status::INCOMPLETE) {
+        switch (state_) {
+            case State::STATUS_LINE:
+            case State::HEADERS:
+            case State::CHUNK_SIZE:
+            case State::CHUNK_DATA_END:
+            case State::TRAILERS: {
+                const char* nl = static_cast<const char*>(
+                    std::memchr(data + pos, '\n', len - pos));
+                size_t take = nl ? (nl - (data + pos)) + 1 : len - pos;
+                line_.append(data + pos, take);
+                pos += take;
+                message_bytes_ += take;
+                
+                if (!nl) {
+                    if (line_.size() > MAX_LINE_LENGTH) fail("Line too long");
+                    break;
+                }
+                
+                std::string_view line(line_);
+                line.remove_suffix(1);
+                if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                
+                bool ok = true;
+                if (state_ == State::STATUS_LINE) {
+                    ok = parse_status_line(line);
+                } else if (state_ == State::HEADERS) {
+                    ok = line.empty() ? end_of_headers() : parse_header(line);
+                } else if (state_ == State::CHUNK_SIZE) {
+                    size_t size = 0;
+                    auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), size, 16);
+                    if (ec != std::errc() || ptr == line.data()) {
+                        ok = fail("Invalid chunk size");
+                    } else if (size == 0) {
+                        state_ = State::TRAILERS;
+                    } else {
+                        remaining_ = size;
+                        state_ = State::CHUNK_DATA;
+                    }
+                } else if (state_ == State::CHUNK_DATA_END) {
+                    ok = line.empty() ? (state_ = State::CHUNK_SIZE, true)
+                                      : fail("Missing CRLF after chunk");
+                } else if (line.empty()) {
+                    state_ = State::DONE;
+                    status_ = Status::COMPLETE;
+                }
+                
+                line_.clear();
+                if (!ok) return pos;
+                break;
+            }
+            
+            case State::BODY_LENGTH:
+            case State::CHUNK_DATA: {
+                size_t take = std::min(remaining_, len - pos);
+                pos += take;
+                remaining_ -= take;
+                message_bytes_ += take;
+                
+                if (remaining_ == 0) {
+                    if (state_ == State::CHUNK_DATA) {
+                        state_ = State::CHUNK_DATA_END;
+                    } else {
+                        state_ = State::DONE;
+                        status_ = Status::COMPLETE;
+                    }
+                }
+                break;
+            }
+            
+            case State::BODY_UNTIL_CLOSE:
+                message_bytes_ += len - pos;
+                pos = len;
+                break;
+            
+            case State::DONE:
+                return pos;
+        }
+    }
+    
+    return pos;
+}
+
+void HttpResponseParser::finish() {
+    if (status_ != Status::INCOMPLETE) return;
+    
+    if (state_ == State::BODY_UNTIL_CLOSE) {
+        state_ = State::DONE;
+        status_ = Status::COMPLETE;
+    } else {
+        fail("Connection closed mid-response");
+    }
+}
+
+void HttpResponseParser::reset() {
+    state_ = State::STATUS_LINE;
+    status_ = Status::INCOMPLETE;
+    line_.clear();
+    error_.clear();
+    status_code_ = 0;
+    keep_alive_ = true;
+    chunked_ = false;
+    has_length_ = false;
+    remaining_ = 0;
+    message_bytes_ = 0;
+}
+
+bool HttpResponseParser::parse_status_line(std::string_view line) {
+    // HTTP/1.1 200 OK
+    if (!line.starts_with("HTTP/1.") || line.size() < 12) {
+        return fail("Malformed status line");
+    }
+    
+    // HTTP/1.0 closes by default
+    keep_alive_ = line[7] != '0';
+    
+    auto [ptr, ec] = std::from_chars(line.data() + 9, line.data() + 12, status_code_);
+    if (ec != std::errc()) {
+        return fail("Malformed status code");
+    }
+    
+    state_ = State::HEADERS;
+    return true;
+}
+
+bool HttpResponseParser::parse_header(std::string_view line) {
+    auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        return fail("Malformed header");
+    }
+    
+    auto name = trim(line.substr(0, colon));
+    auto value = trim(line.substr(colon + 1));
+    
+    if (iequals(name, "Content-Length")) {
+        auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), remaining_);
+        if (ec != std::errc()) {
+            return fail("Invalid Content-Length");
+        }
+        has_length_ = true;
+    } else if (iequals(name, "Transfer-Encoding")) {
+        chunked_ = contains_token(value, "chunked");
+    } else if (iequals(name, "Connection")) {
+        if (contains_token(value, "close")) {
+            keep_alive_ = false;
+        } else if (contains_token(value, "keep-alive")) {
+            keep_alive_ = true;
+        }
+    }
+    
+    return true;
+}
+
+bool HttpResponseParser::end_of_headers() {
+    if (status_code_ >= 100 && status_code_ < 200) {
+        // Interim response: the final one follows on the same stream
+        state_ = State::STATUS_LINE;
+        return true;
+    }
+    
+    // 204 and 304 never carry a body
+    bool no_body = status_code_ == 204 || status_code_ == 304;
+    
+    if (no_body || (!chunked_ && has_length_ && remaining_ == 0)) {
+        state_ = State::DONE;
+        status_ = Status::COMPLETE;
+    } else if (chunked_) {
+        state_ = State::CHUNK_SIZE;
+    } else if (has_length_) {
+        state_ = State::BODY_LENGTH;
+    } else {
+        keep_alive_ = false;
+        state_ = State::BODY_UNTIL_CLOSE;
+    }
+    
+    return true;
+}
+
+bool HttpResponseParser::fail(std::string message) {
+    error_ = std::move(message);
+    status_ = Status::ERROR;
+    keep_alive_ = false;
+    return false;
+}
+
+} // namespace netprobe
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "common.h"
+#include <string>
+
+namespace netprobe {
+
+// Incremental HTTP/1.1 response parser.
+//
+// Bytes are fed as they arrive from the socket; the parser consumes at most
+// one response and reports how many bytes it used, so the remainder of the
+// buffer belongs to the next response on a reused connection. Message
+// boundaries come from Content-Length or chunked transfer coding; bodies
+// delimited only by connection close are flagged as not reusable.
+class HttpResponseParser {
+public:
+    enum class Status {
+        INCOMPLETE,
+        COMPLETE,
+        ERROR
+    };
+    
+    // Feed received bytes; returns the number of bytes consumed
+    size_t feed(const char* data, size_t len);
+    
+    // Signal EOF; completes a close-delimited body
+    void finish();
+    
+    // Prepare for the next response on the same connection
+    void reset();
+    
+    Status status() const { return status_; }
+    int status_code() const { return status_code_; }
+    bool keep_alive() const { return keep_alive_; }
+    size_t message_bytes() const { return message_bytes_; }
+    const std::string& error() const { return error_; }
+
+private:
+    enum class State {
+        STATUS_LINE,
+        HEADERS,
+        BODY_LENGTH,
+        BODY_UNTIL_CLOSE,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        TRAILERS,
+        DONE
+    };
+    
+    bool parse_status_line(std::string_view line);
+    bool parse_header(std::string_view line);
+    bool end_of_headers();
+    bool fail(std::string message);
+    
+    State state_ = State::STATUS_LINE;
+    Status status_ = Status::INCOMPLETE;
+    std::string line_;
+    std::string error_;
+    
+    int status_code_ = 0;
+    bool keep_alive_ = true;
+    bool chunked_ = false;
+    bool has_length_ = false;
+    size_t remaining_ = 0;
+    size_t message_bytes_ = 0;
+};
+
+} // namespace netprobe
@@ -0,0 +1,53 @@
+#include "packet.h"
+#include <cstring>
+
+namespace netprobe {
+
+namespace {
+
+// One's complement sum of 16-bit words, not yet folded. Words are read
+// with memcpy: callers pass structs of other types, and aliasing them
+// through uint16_t* lets the optimizer read before the fields are written.
+uint32_t sum_words(const void* data, size_t len, uint32_t sum = 0) {
+    const uint8_t* buf = static_cast<const uint8_t*>(data);
+    
+    while (len > 1) {
+        uint16_t word;
+        std::memcpy(&word, buf, sizeof(word));
+        sum += word;
+        buf += 2;
+        len -= 2;
+    }
+    
+    if (len == 1) {
+        sum += *buf;
+    }
+    return sum;
+}
+
+uint16_t fold(uint32_t sum) {
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum += (sum >> 16);
+    return static_cast<uint16_t>(~sum);
+}
+
+} // anonymous namespace
+
+uint16_t checksum(const void* data, size_t len) {
+    return fold(sum_words(data, len));
+}
+
+uint16_t transport_checksum(in_addr_t source, in_addr_t dest, uint8_t protocol,
+                            const void* segment, size_t len) {
+    struct {
+        in_addr_t source;
+        in_addr_t dest;
+        uint8_t zero;
+        uint8_t protocol;
+        uint16_t length;
+    } pseudo{source, dest, 0, protocol, htons(static_cast<uint16_t>(len))};
+    
+    return fold(sum_words(segment, len, sum_words(&pseudo, sizeof(pseudo))));
+}
+
+} // namespace netprobe
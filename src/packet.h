@@ -0,0 +1,17 @@
+#pragma once
+
+#include "common.h"
+#include <netinet/in.h>
+
+namespace netprobe {
+
+// Internet checksum (RFC 1071) of `len` bytes
+uint16_t checksum(const void* data, size_t len);
+
+// TCP or UDP checksum of a whole segment, covering the IPv4 pseudo-header.
+// Addresses are in network byte order; the segment's own checksum field
+// must be zero.
+uint16_t transport_checksum(in_addr_t source, in_addr_t dest, uint8_t protocol,
+                            const void* segment, size_t len);
+
+} // namespace netprobe
@@ -0,0 +1,122 @@
+#include "runtime.h"
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <latch>
+
+namespace netprobe {
+
+namespace {
+
+// CPU ids in this process's affinity mask, in ascending order
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+} // anonymous namespace
+
+Runtime::Runtime(Options options) : options_(options) {
+    cores_ = options_.cores ? options_.cores : available_cores();
+}
+
+Runtime::~Runtime() {
+    stop();
+    join();
+    
+    for (auto& reactor : reactors_) {
+        if (reactor->wake_fd >= 0) {
+            ::close(reactor->wake_fd);
+        }
+    }
+}
+
+size_t Runtime::available_cores() {
+    return std::max<size_t>(1, allowed_cpus().size());
+}
+
+std::pair<size_t, size_t> Runtime::shard(size_t total, size_t index, size_t shards) {
+    size_t base = total / shards;
+    size_t extra = total % shards;
+    size_t first = index * base + std::min(index, extra);
+    return {first, base + (index < extra ? 1 : 0)};
+}
+
+void Runtime::start(Setup setup) {
+    auto cpus = allowed_cpus();
+    std::latch ready(static_cast<std::ptrdiff_t>(cores_));
+    
+    for (size_t i = 0; i < cores_; ++i) {
+        auto reactor = std::make_unique<Reactor>();
+        reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        reactors_.push_back(std::move(reactor));
+    }
+    
+    for (size_t i = 0; i < cores_; ++i) {
+        // More reactors than CPUs wrap around rather than going unpinned
+        int cpu = options_.pin && !cpus.empty() ? cpus[i % cpus.size()] : -1;
+        
+        reactors_[i]->thread = std::thread([this, i, cpu, &setup, &ready]() {
+            run_reactor(i, cpu, setup);
+            ready.count_down();
+            reactors_[i]->io->run();
+        });
+    }
+    
+    ready.wait();
+}
+
+void Runtime::run_reactor(size_t index, int cpu, const Setup& setup) {
+    auto& reactor = *reactors_[index];
+    
+    // Pin before allocating so the reactor's memory lands on its node
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    
+    reactor.io = std::make_unique<AsyncIO>(options_.backend);
+    
+    if (reactor.wake_fd >= 0) {
+        int wake_fd = reactor.wake_fd;
+        AsyncIO* io = reactor.io.get();
+        io->add(wake_fd, AsyncIO::Event::READ, [io, wake_fd](int, AsyncIO::Event) {
+            uint64_t value;
+            [[maybe_unused]] auto n = ::read(wake_fd, &value, sizeof(value));
+            io->stop();
+        });
+    }
+    
+    setup(index, *reactor.io);
+}
+
+void Runtime::stop() {
+    uint64_t one = 1;
+    for (auto& reactor : reactors_) {
+        if (reactor->wake_fd >= 0) {
+            [[maybe_unused]] auto n = ::write(reactor->wake_fd, &one, sizeof(one));
+        }
+    }
+}
+
+void Runtime::join() {
+    for (auto& reactor : reactors_) {
+        if (reactor->thread.joinable()) {
+            reactor->thread.join();
+        }
+    }
+}
+
+} // namespace netprobe
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+#include "async_io.h"
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace netprobe {
+
+// Thread-per-core reactor runtime.
+//
+// Starts one AsyncIO loop per core, each on its own thread and optionally
+// pinned to its CPU. Work is sharded up front: each reactor's setup
+// callback creates the sockets and state that reactor owns, and nothing
+// is shared between reactors afterwards, so the hot path takes no locks.
+// The reactor and everything it touches are created on its own thread,
+// which keeps their memory local to that core.
+class Runtime {
+public:
+    struct Options {
+        size_t cores = 0;           // 0: every CPU this process may run on
+        bool pin = true;            // Pin reactor i to the i-th allowed CPU
+        AsyncIO::Backend backend = AsyncIO::Backend::AUTO;
+    };
+    
+    // Runs on reactor `index`'s thread before its loop starts
+    using Setup = std::function<void(size_t index, AsyncIO& io)>;
+    
+    explicit Runtime(Options options);
+    ~Runtime();
+    
+    Runtime(const Runtime&) = delete;
+    Runtime& operator=(const Runtime&) = delete;
+    
+    // Start the reactors; returns once every setup callback has finished
+    void start(Setup setup);
+    
+    // Ask every reactor to leave its loop; safe from any thread. Reactors
+    // may also stop themselves with AsyncIO::stop().
+    void stop();
+    
+    // Wait for every reactor loop to finish
+    void join();
+    
+    size_t size() const { return cores_; }
+    
+    // Only touch a reactor from its own thread, or after join()
+    AsyncIO& reactor(size_t index) { return *reactors_[index]->io; }
+    
+    // CPUs this process is allowed to run on
+    static size_t available_cores();
+    
+    // Split `total` items over `shards` as evenly as possible; returns
+    // {first, count} for shard `index`
+    static std::pair<size_t, size_t> shard(size_t total, size_t index, size_t shards);
+
+private:
+    struct Reactor {
+        std::unique_ptr<AsyncIO> io;
+        int wake_fd = -1;           // eventfd that stop() signals
+        std::thread thread;
+    };
+    
+    void run_reactor(size_t index, int cpu, const Setup& setup);
+    
+    Options options_;
+    size_t cores_;
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+};
+
+} // namespace netprobe
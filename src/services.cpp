@@ -0,0 +1,197 @@
+#include "services.h"
+#include <algorithm>
+#include <iterator>
+#include <regex>
+#include <vector>
+
+namespace netprobe {
+
+namespace {
+
+using namespace std::string_view_literals;
+
+// Sorted by protocol, then port
+constexpr Service SERVICES[] = {
+    {Protocol::TCP, 20, "ftp-data", {}},
+    {Protocol::TCP, 21, "ftp", {}},
+    {Protocol::TCP, 22, "ssh", {}},
+    {Protocol::TCP, 23, "telnet", {}},
+    {Protocol::TCP, 25, "smtp", {}},
+    {Protocol::TCP, 53, "dns", {}},
+    {Protocol::TCP, 80, "http", {}},
+    {Protocol::TCP, 110, "pop3", {}},
+    {Protocol::TCP, 143, "imap", {}},
+    {Protocol::TCP, 443, "https", {}},
+    {Protocol::TCP, 465, "smtps", {}},
+    {Protocol::TCP, 587, "smtp", {}},
+    {Protocol::TCP, 993, "imaps", {}},
+    {Protocol::TCP, 995, "pop3s", {}},
+    {Protocol::TCP, 3306, "mysql", {}},
+    {Protocol::TCP, 5432, "postgresql", {}},
+    // Inline command; the reply starts with the server version
+    {Protocol::TCP, 6379, "redis", "INFO server\r\n"sv},
+    {Protocol::TCP, 8080, "http-alt", {}},
+    {Protocol::TCP, 8443, "https-alt", {}},
+    {Protocol::TCP, 11211, "memcached", "version\r\n"sv},
+    {Protocol::TCP, 27017, "mongodb", {}},
+    
+    // Query for the root name servers
+    {Protocol::UDP, 53, "dns",
+        "\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x02\x00\x01"sv},
+    {Protocol::UDP, 67, "dhcps", {}},
+    // Read request for a file that should not exist; answered by an error
+    {Protocol::UDP, 69, "tftp", "\x00\x01" "netprobe.txt" "\x00" "octet" "\x00"sv},
+    // Portmapper NULL call
+    {Protocol::UDP, 111, "rpcbind",
+        "\x72\xfe\x1d\x13\x00\x00\x00\x00\x00\x00\x00\x02\x00\x01\x86\xa0"
+        "\x00\x00\x00\x02\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\x00\x00\x00\x00\x00\x00\x00\x00"sv},
+    // Version 4 client request
+    {Protocol::UDP, 123, "ntp",
+        "\xe3\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"sv},
+    // Node status request for the wildcard name
+    {Protocol::UDP, 137, "netbios-ns",
+        "\x80\xf0\x00\x10\x00\x01\x00\x00\x00\x00\x00\x00\x20"
+        "CKAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA" "\x00\x00\x21\x00\x01"sv},
+    // SNMPv1 get of sysDescr.0 with community "public"
+    {Protocol::UDP, 161, "snmp",
+        "\x30\x29\x02\x01\x00\x04\x06" "public" "\xa0\x1c\x02\x04\x71\xb4\xb5\x68"
+        "\x02\x01\x00\x02\x01\x00\x30\x0e\x30\x0c\x06\x08\x2b\x06\x01\x02"
+        "\x01\x01\x01\x00\x05\x00"sv},
+    {Protocol::UDP, 500, "isakmp", {}},
+    {Protocol::UDP, 514, "syslog", {}},
+    // OpenVPN hard reset from a client
+    {Protocol::UDP, 1194, "openvpn",
+        "\x38\x01\x02\x03\x04\x05\x06\x07\x08\x00\x00\x00\x00\x00"sv},
+    {Protocol::UDP, 1812, "radius", {}},
+    {Protocol::UDP, 1900, "ssdp",
+        "M-SEARCH * HTTP/1.1\r\nHOST: 239.255.255.250:1900\r\n"
+        "MAN: \"ssdp:discover\"\r\nMX: 1\r\nST: ssdp:all\r\n\r\n"sv},
+    // STUN binding request
+    {Protocol::UDP, 3478, "stun",
+        "\x00\x01\x00\x00\x21\x12\xa4\x42" "netprobe-stn"sv},
+    {Protocol::UDP, 4500, "ipsec-nat-t", {}},
+    // NAT-PMP external address request
+    {Protocol::UDP, 5351, "nat-pmp", "\x00\x00"sv},
+    // Unicast query for the DNS-SD service list
+    {Protocol::UDP, 5353, "mdns",
+        "\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+        "\x09_services\x07_dns-sd\x04_udp\x05local\x00" "\x00\x0c\x00\x01"sv},
+    // Frame header, then a request with a short reply
+    {Protocol::UDP, 11211, "memcached",
+        "\x00\x01\x00\x00\x00\x01\x00\x00" "version\r\n"sv},
+};
+
+constexpr bool service_less(const Service& a, const Service& b) {
+    return a.protocol != b.protocol ? a.protocol < b.protocol : a.port < b.port;
+}
+
+static_assert(std::is_sorted(std::begin(SERVICES), std::end(SERVICES), service_less));
+
+// Sent to TCP services that wait for the client; most of them are web
+// servers, and many others answer a line of HTTP with an error that
+// still gives them away
+constexpr std::string_view DEFAULT_TCP_PROBE = "HEAD / HTTP/1.0\r\n\r\n";
+
+// Longest version string kept from a banner
+constexpr size_t MAX_VERSION = 80;
+
+// A pattern over the start of a reply. The first capture group, if
+// any, is the version.
+struct Signature {
+    const char* service;
+    const char* pattern;
+    bool icase;
+};
+
+// Tried in order; the first match wins
+constexpr Signature SIGNATURES[] = {
+    {"ssh", R"(^SSH-[\d.]+-([^\r\n]+))", false},
+    {"http", R"(^HTTP/\d\.\d \d{3}[\s\S]*?\r\nserver:[ \t]*([^\r\n]+))", true},
+    {"http", R"(^HTTP/\d\.\d \d{3})", false},
+    {"redis", R"(^\$\d+\r\n# Server\r\nredis_version:([^\r\n]+))", false},
+    {"redis", R"(^-(?:NOAUTH|DENIED))", false},
+    {"smtp", R"(^220[ -]([^\r\n]*SMTP[^\r\n]*))", false},
+    {"ftp", R"(^220[ -]([^\r\n]*FTP[^\r\n]*))", true},
+    {"pop3", R"(^\+OK ?([^\r\n]*))", false},
+    {"imap", R"(^\* OK ?([^\r\n]*))", false},
+    // Handshake: 3-byte length, sequence 0, protocol 10, server version
+    {"mysql", R"(^[\s\S]{3}\x00\x0a([0-9][\w.+~-]*))", false},
+    // Error response to a startup packet it could not parse
+    {"postgresql", R"(^E[\s\S]{4}SFATAL)", false},
+    {"memcached", R"(^VERSION ([^\r\n]+))", false},
+    {"vnc", R"(^RFB (\d{3}\.\d{3}))", false},
+    {"amqp", R"(^AMQP)", false},
+    // IAC followed by WILL, WONT, DO or DONT
+    {"telnet", R"(^\xff(?:\xfb|\xfc|\xfd|\xfe))", false},
+    // Alert record in answer to a request that was not a TLS handshake
+    {"ssl/tls", R"(^\x15\x03(?:\x00|\x01|\x02|\x03))", false},
+};
+
+struct CompiledSignature {
+    std::string service;
+    std::regex pattern;
+};
+
+// Compiled on first use; matching is safe from any thread
+const std::vector<CompiledSignature>& compiled_signatures() {
+    static const std::vector<CompiledSignature> compiled = [] {
+        std::vector<CompiledSignature> out;
+        for (const auto& sig : SIGNATURES) {
+            auto flags = std::regex::ECMAScript | std::regex::optimize;
+            if (sig.icase) flags |= std::regex::icase;
+            out.push_back({sig.service, std::regex(sig.pattern, flags)});
+        }
+        return out;
+    }();
+    return compiled;
+}
+
+// Printable ASCII up to the end of the line, trimmed and cut to MAX_VERSION
+std::string printable_line(std::string_view text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '\r' || c == '\n' || out.size() == MAX_VERSION) break;
+        if (c >= 0x20 && c < 0x7f) out += c;
+    }
+    
+    auto first = out.find_first_not_of(' ');
+    if (first == std::string::npos) return {};
+    return out.substr(first, out.find_last_not_of(' ') - first + 1);
+}
+
+} // anonymous namespace
+
+const Service* find_service(Protocol protocol, uint16_t port) {
+    Service key{protocol, port, {}, {}};
+    auto it = std::lower_bound(std::begin(SERVICES), std::end(SERVICES), key, service_less);
+    return it != std::end(SERVICES) && it->protocol == protocol && it->port == port ? &*it : nullptr;
+}
+
+std::string get_service_name(uint16_t port, Protocol protocol) {
+    const Service* service = find_service(protocol, port);
+    return service ? std::string(service->name) : "unknown";
+}
+
+std::string_view banner_probe(uint16_t port) {
+    const Service* service = find_service(Protocol::TCP, port);
+    return service && !service->probe.empty() ? service->probe : DEFAULT_TCP_PROBE;
+}
+
+Fingerprint identify(std::string_view banner) {
+    for (const auto& sig : compiled_signatures()) {
+        std::match_results<std::string_view::const_iterator> match;
+        if (std::regex_search(banner.begin(), banner.end(), match, sig.pattern)) {
+            std::string_view version;
+            if (match.size() > 1 && match[1].matched) {
+                version = banner.substr(match.position(1), match.length(1));
+            }
+            return {sig.service, printable_line(version)};
+        }
+    }
+    return {{}, printable_line(banner)};
+}
+
+} // namespace netprobe
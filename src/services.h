@@ -0,0 +1,44 @@
+#pragma once
+
+#include "common.h"
+#include <string>
+#include <string_view>
+
+namespace netprobe {
+
+enum class Protocol {
+    TCP,
+    UDP
+};
+
+// A well-known service on a port, with the payload most likely to draw a
+// reply. Most UDP services ignore a datagram they cannot parse, so an
+// empty probe cannot tell them from a filtered port; a TCP service is only
+// sent its probe when it does not speak first.
+struct Service {
+    Protocol protocol;
+    uint16_t port;
+    std::string_view name;
+    std::string_view probe;     // Empty: an empty datagram, or the TCP default
+};
+
+// What the first bytes from a TCP service give away about it
+struct Fingerprint {
+    std::string service;        // Empty when no signature matched
+    std::string version;        // Product and version, else the first line
+};
+
+// The service registered for `port`, or nullptr
+const Service* find_service(Protocol protocol, uint16_t port);
+
+// Its name, or "unknown"
+std::string get_service_name(uint16_t port, Protocol protocol = Protocol::TCP);
+
+// What to send a TCP service on `port` that has not spoken first; an HTTP
+// request unless the port is known to expect something else
+std::string_view banner_probe(uint16_t port);
+
+// Match a banner or probe reply against the known signatures
+Fingerprint identify(std::string_view banner);
+
+} // namespace netprobe
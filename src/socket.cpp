@@ -45,6 +45,17 @@ Result<void> Socket::create(Type type) {
             protocol = IPPROTO_UDP;
             break;
         case Type::ICMP:
+            // Ping sockets need no privilege where net.ipv4.ping_group_range
+            // admits the user, and the kernel hands each one only its own
+            // echo replies; a raw socket sees every ICMP packet on the host
+            fd_ = ::socket(domain, SOCK_DGRAM, IPPROTO_ICMP);
+            if (fd_ >= 0) {
+                return Result<void>();
+            }
+            sock_type = SOCK_RAW;
+            protocol = IPPROTO_ICMP;
+            break;
+        case Type::ICMP_RAW:
             sock_type = SOCK_RAW;
             protocol = IPPROTO_ICMP;
             break;
@@ -113,6 +124,35 @@ Result<void> Socket::connect(std::string_view host, uint16_t port,
     return Result<void>();
 }
 
+Result<void> Socket::start_connect(const sockaddr_in& addr) {
+    if (auto res = set_nonblocking(true); !res) {
+        return res;
+    }
+    
+    int result = ::connect(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    if (result < 0 && errno != EINPROGRESS) {
+        return Result<void>(std::format("Connect failed: {}", 
+            std::strerror(errno)));
+    }
+    
+    return Result<void>();
+}
+
+int Socket::pending_error() const {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+        return errno;
+    }
+    return error;
+}
+
+bool Socket::is_raw() const {
+    int type = 0;
+    socklen_t len = sizeof(type);
+    return ::getsockopt(fd_, SOL_SOCKET, SO_TYPE, &type, &len) == 0 && type == SOCK_RAW;
+}
+
 Result<void> Socket::bind(uint16_t port) {
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
@@ -188,13 +228,12 @@ Result<void> Socket::set_nonblocking(bool enabled) {
         return Result<void>("Failed to get socket flags");
     }
     
-    if (enabled) {
-        flags |= O_NONBLOCK;
-    } else {
-        flags &= ~O_NONBLOCK;
+    int wanted = enabled ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    if (wanted == flags) {
+        return Result<void>();
     }
     
-    if (::fcntl(fd_, F_SETFL, flags) < 0) {
+    if (::fcntl(fd_, F_SETFL, wanted) < 0) {
         return Result<void>("Failed to set non-blocking mode");
     }
     
@@ -240,6 +279,14 @@ Result<void> Socket::set_ttl(int ttl) {
     return Result<void>();
 }
 
+Result<void> Socket::set_nodelay(bool enabled) {
+    int opt = enabled ? 1 : 0;
+    if (::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) < 0) {
+        return Result<void>("Failed to set TCP_NODELAY");
+    }
+    return Result<void>();
+}
+
 void Socket::close() {
     if (fd_ >= 0) {
         ::close(fd_);
@@ -14,7 +14,8 @@ public:
     enum class Type {
         TCP,
         UDP,
-        ICMP,
+        ICMP,       // Ping socket where allowed, otherwise raw
+        ICMP_RAW,   // Always raw: sees every ICMP packet, errors included
         RAW
     };
     
@@ -38,6 +39,12 @@ public:
     Result<void> connect(std::string_view host, uint16_t port, 
                         std::chrono::milliseconds timeout = 1000ms);
     
+    // Begin a non-blocking connect; completion is signalled by writability
+    Result<void> start_connect(const sockaddr_in& addr);
+    
+    // Pending socket error (SO_ERROR), 0 once a connect has succeeded
+    int pending_error() const;
+    
     // Bind
     Result<void> bind(uint16_t port);
     
@@ -61,11 +68,16 @@ public:
     Result<void> set_reuse_port(bool enabled);
     Result<void> set_timeout(std::chrono::milliseconds timeout);
     Result<void> set_ttl(int ttl);
+    Result<void> set_nodelay(bool enabled);
     
     // Get info
     int fd() const { return fd_; }
     bool is_valid() const { return fd_ >= 0; }
     
+    // Whether this is a SOCK_RAW socket. An ICMP socket is a datagram
+    // ping socket instead wherever the kernel allows one.
+    bool is_raw() const;
+    
     // Close
     void close();
     
@@ -1,33 +1,231 @@
 #include "stats.h"
 #include <stdexcept>
+#include <cstring>
+#include <format>
 
 namespace netprobe {
 
+// BucketLayout implementation
+BucketLayout::BucketLayout(int significant_digits)
+    : digits_(std::clamp(significant_digits, 1, 5)) {
+    // Enough linear sub-buckets that adjacent values differ by less than
+    // one unit in the last significant digit
+    uint64_t largest = 2;
+    for (int i = 0; i < digits_; ++i) largest *= 10;
+    
+    sub_bits_ = 64 - __builtin_clzll(largest - 1);
+    sub_count_ = size_t{1} << sub_bits_;
+    sub_half_ = sub_count_ / 2;
+    bucket_count_ = sub_count_ + (MAX_VALUE_BITS - sub_bits_) * sub_half_;
+}
+
+size_t BucketLayout::index_of(uint64_t nanos) const {
+    if (nanos < sub_count_) return nanos;
+    
+    // Each power of two above the linear range adds sub_half_ buckets
+    int msb = 63 - __builtin_clzll(nanos);
+    int shift = msb - (sub_bits_ - 1);
+    size_t index = sub_count_ + (shift - 1) * sub_half_ + ((nanos >> shift) - sub_half_);
+    return std::min(index, bucket_count_ - 1);
+}
+
+uint64_t BucketLayout::lowest_in(size_t index) const {
+    if (index < sub_count_) return index;
+    size_t shift = (index - sub_count_) / sub_half_ + 1;
+    uint64_t mantissa = (index - sub_count_) % sub_half_ + sub_half_;
+    return mantissa << shift;
+}
+
+uint64_t BucketLayout::highest_in(size_t index) const {
+    if (index < sub_count_) return index;
+    size_t shift = (index - sub_count_) / sub_half_ + 1;
+    return lowest_in(index) + (uint64_t{1} << shift) - 1;
+}
+
+// Histogram implementation
+Histogram::Histogram(int significant_digits)
+    : layout_(significant_digits), counts_(layout_.bucket_count(), 0) {}
+
+uint64_t Histogram::to_nanos(double ms) {
+    if (!(ms > 0.0)) return 0;
+    return static_cast<uint64_t>(std::llround(ms * 1e6));
+}
+
+void Histogram::add(double value) {
+    add_nanos(to_nanos(value));
+}
+
+void Histogram::add_nanos(uint64_t nanos) {
+    ++counts_[layout_.index_of(nanos)];
+    ++count_;
+    sum_ns_ += nanos;
+    min_ns_ = std::min(min_ns_, nanos);
+    max_ns_ = std::max(max_ns_, nanos);
+}
+
+void Histogram::add_bucket(size_t index, uint64_t count) {
+    counts_[index] += count;
+    count_ += count;
+}
+
+void Histogram::merge(const Histogram& other) {
+    if (layout_ == other.layout_) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+    } else {
+        // Re-bucket at this histogram's precision
+        for (size_t i = 0; i < other.counts_.size(); ++i) {
+            if (other.counts_[i] == 0) continue;
+            uint64_t mid = other.layout_.lowest_in(i) +
+                (other.layout_.highest_in(i) - other.layout_.lowest_in(i)) / 2;
+            counts_[layout_.index_of(mid)] += other.counts_[i];
+        }
+    }
+    count_ += other.count_;
+    sum_ns_ += other.sum_ns_;
+    min_ns_ = std::min(min_ns_, other.min_ns_);
+    max_ns_ = std::max(max_ns_, other.max_ns_);
+}
+
+void Histogram::reset() {
+    std::ranges::fill(counts_, 0);
+    count_ = 0;
+    sum_ns_ = 0;
+    min_ns_ = UINT64_MAX;
+    max_ns_ = 0;
+}
+
+double Histogram::min() const {
+    return count_ == 0 ? 0.0 : min_ns_ / 1e6;
+}
+
+double Histogram::max() const {
+    return count_ == 0 ? 0.0 : max_ns_ / 1e6;
+}
+
+double Histogram::mean() const {
+    return count_ == 0 ? 0.0 : (static_cast<double>(sum_ns_) / count_) / 1e6;
+}
+
+double Histogram::stddev() const {
+    if (count_ < 2) return 0.0;
+    
+    double mean_ns = static_cast<double>(sum_ns_) / count_;
+    double sum_sq = 0.0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        if (counts_[i] == 0) continue;
+        double mid = (layout_.lowest_in(i) + layout_.highest_in(i)) / 2.0;
+        sum_sq += counts_[i] * (mid - mean_ns) * (mid - mean_ns);
+    }
+    return std::sqrt(sum_sq / (count_ - 1)) / 1e6;
+}
+
+double Histogram::percentile(double p) const {
+    if (count_ == 0) return 0.0;
+    if (p <= 0.0) return min();
+    if (p >= 100.0) return max();
+    
+    uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * count_));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            uint64_t mid = layout_.lowest_in(i) +
+                (layout_.highest_in(i) - layout_.lowest_in(i)) / 2;
+            return std::min(std::max(mid, min_ns_), max_ns_) / 1e6;
+        }
+    }
+    return max();
+}
+
+// Statistics implementation
+Statistics::Statistics(Backend backend, int significant_digits) : backend_(backend) {
+    if (backend_ == Backend::HISTOGRAM) {
+        histogram_.emplace(significant_digits);
+    }
+}
+
 void Statistics::add(double value) {
-    values_.push_back(value);
+    if (backend_ == Backend::HISTOGRAM) {
+        histogram_->add(value);
+    } else {
+        values_.push_back(value);
+        sorted_ = false;
+    }
+    
+    if (count_ == 0) {
+        min_ = max_ = value;
+    } else {
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        jitter_sum_ += std::abs(value - last_);
+    }
+    last_ = value;
+    ++count_;
     sum_ += value;
     sum_sq_ += value * value;
 }
 
 void Statistics::reset() {
     values_.clear();
+    sorted_ = true;
+    if (histogram_) histogram_->reset();
+    count_ = 0;
     sum_ = 0.0;
     sum_sq_ = 0.0;
+    min_ = max_ = last_ = 0.0;
+    jitter_sum_ = 0.0;
+}
+
+void Statistics::merge(const Statistics& other) {
+    if (other.count_ == 0) return;
+    
+    if (other.backend_ == Backend::HISTOGRAM && backend_ == Backend::EXACT) {
+        switch_to_histogram(other.histogram_->layout().significant_digits());
+    }
+    
+    if (backend_ == Backend::HISTOGRAM) {
+        if (other.backend_ == Backend::HISTOGRAM) {
+            histogram_->merge(*other.histogram_);
+        } else {
+            for (double v : other.values_) histogram_->add(v);
+        }
+    } else {
+        values_.insert(values_.end(), other.values_.begin(), other.values_.end());
+        sorted_ = false;
+    }
+    
+    // Jitter is order-dependent; treat the merged runs as concatenated
+    min_ = count_ == 0 ? other.min_ : std::min(min_, other.min_);
+    max_ = count_ == 0 ? other.max_ : std::max(max_, other.max_);
+    jitter_sum_ += other.jitter_sum_;
+    last_ = other.last_;
+    count_ += other.count_;
+    sum_ += other.sum_;
+    sum_sq_ += other.sum_sq_;
+}
+
+void Statistics::switch_to_histogram(int significant_digits) {
+    histogram_.emplace(significant_digits);
+    for (double v : values_) histogram_->add(v);
+    values_.clear();
+    values_.shrink_to_fit();
+    sorted_ = true;
+    backend_ = Backend::HISTOGRAM;
 }
 
 double Statistics::min() const {
-    if (values_.empty()) return 0.0;
-    return *std::ranges::min_element(values_);
+    return min_;
 }
 
 double Statistics::max() const {
-    if (values_.empty()) return 0.0;
-    return *std::ranges::max_element(values_);
+    return max_;
 }
 
 double Statistics::mean() const {
-    if (values_.empty()) return 0.0;
-    return sum_ / values_.size();
+    if (count_ == 0) return 0.0;
+    return sum_ / count_;
 }
 
 double Statistics::median() const {
@@ -35,37 +233,462 @@ double Statistics::median() const {
 }
 
 double Statistics::stddev() const {
-    if (values_.size() < 2) return 0.0;
-    double variance = (sum_sq_ - sum_ * sum_ / values_.size()) / (values_.size() - 1);
+    if (count_ < 2) return 0.0;
+    double variance = (sum_sq_ - sum_ * sum_ / count_) / (count_ - 1);
     return std::sqrt(std::max(0.0, variance));
 }
 
 double Statistics::percentile(double p) const {
-    if (values_.empty()) return 0.0;
+    if (count_ == 0) return 0.0;
     if (p <= 0.0) return min();
     if (p >= 100.0) return max();
     
-    auto sorted = values_;
-    std::ranges::sort(sorted);
+    if (backend_ == Backend::HISTOGRAM) {
+        return histogram_->percentile(p);
+    }
+    
+    // Sort once; repeated percentile queries reuse the order
+    if (!sorted_) {
+        std::ranges::sort(values_);
+        sorted_ = true;
+    }
     
-    double index = (p / 100.0) * (sorted.size() - 1);
+    double index = (p / 100.0) * (values_.size() - 1);
     size_t lower = static_cast<size_t>(std::floor(index));
     size_t upper = static_cast<size_t>(std::ceil(index));
     
-    if (lower == upper) return sorted[lower];
+    if (lower == upper) return values_[lower];
     
     double weight = index - lower;
-    return sorted[lower] * (1.0 - weight) + sorted[upper] * weight;
+    return values_[lower] * (1.0 - weight) + values_[upper] * weight;
 }
 
 double Statistics::jitter() const {
-    if (values_.size() < 2) return 0.0;
+    if (count_ < 2) return 0.0;
+    return jitter_sum_ / (count_ - 1);
+}
+
+// RollingWindow implementation
+RollingWindow::RollingWindow(size_t capacity)
+    : samples_(std::max<size_t>(capacity, 1)), last_(std::nan("")) {}
+
+void RollingWindow::add(double value) {
+    push(value);
+    last_ = value;
+}
+
+void RollingWindow::add_loss() {
+    push(std::nan(""));
+}
+
+void RollingWindow::push(double value) {
+    // The oldest sample makes room once the ring is full
+    if (size_ == samples_.size()) {
+        double old = samples_[next_];
+        if (!std::isnan(old)) {
+            --received_;
+            sum_ -= old;
+            sum_sq_ -= old * old;
+        }
+    } else {
+        ++size_;
+    }
+    
+    samples_[next_] = value;
+    next_ = (next_ + 1) % samples_.size();
+    if (!std::isnan(value)) {
+        ++received_;
+        sum_ += value;
+        sum_sq_ += value * value;
+    }
+    
+    // Subtraction leaves rounding behind; an empty window starts clean
+    if (received_ == 0) sum_ = sum_sq_ = 0.0;
+}
+
+double RollingWindow::loss() const {
+    if (size_ == 0) return 0.0;
+    return 100.0 * static_cast<double>(size_ - received_) / static_cast<double>(size_);
+}
+
+double RollingWindow::min() const {
+    double best = 0.0;
+    bool any = false;
+    for (size_t i = 0; i < size_; ++i) {
+        if (std::isnan(samples_[i])) continue;
+        best = any ? std::min(best, samples_[i]) : samples_[i];
+        any = true;
+    }
+    return best;
+}
+
+double RollingWindow::max() const {
+    double worst = 0.0;
+    for (size_t i = 0; i < size_; ++i) {
+        if (!std::isnan(samples_[i])) worst = std::max(worst, samples_[i]);
+    }
+    return worst;
+}
+
+double RollingWindow::mean() const {
+    if (received_ == 0) return 0.0;
+    return sum_ / static_cast<double>(received_);
+}
+
+double RollingWindow::stddev() const {
+    if (received_ < 2) return 0.0;
+    double n = static_cast<double>(received_);
+    double variance = (sum_sq_ - sum_ * sum_ / n) / (n - 1);
+    return std::sqrt(std::max(0.0, variance));
+}
+
+// QuantileSketch implementation
+namespace {
+
+constexpr char SKETCH_MAGIC[4] = {'N', 'P', 'T', 'D'};
+constexpr uint8_t SKETCH_VERSION = 1;
+
+// t-digest k2 scale function and its inverse. Centroid sizes shrink
+// geometrically towards q = 0 and q = 1, which keeps p99.9 and beyond
+// accurate; `norm` spreads the k range according to the sample count.
+double scale_norm(double compression, double count) {
+    return 4.0 * std::log(std::max(count / compression, 1.0)) + 24.0;
+}
+
+double scale_k(double q, double compression, double norm) {
+    q = std::clamp(q, 1e-15, 1.0 - 1e-15);
+    return compression / norm * std::log(q / (1.0 - q));
+}
+
+double scale_q(double k, double compression, double norm) {
+    return 1.0 / (1.0 + std::exp(-k * norm / compression));
+}
+
+void put_bytes(std::string& out, const void* data, size_t len) {
+    out.append(static_cast<const char*>(data), len);
+}
+
+void put_double(std::string& out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>(bits >> (8 * i)));
+}
+
+void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool get_double(std::string_view& in, double& value) {
+    if (in.size() < 8) return false;
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) bits |= uint64_t{static_cast<uint8_t>(in[i])} << (8 * i);
+    std::memcpy(&value, &bits, sizeof(value));
+    in.remove_prefix(8);
+    return true;
+}
+
+bool get_varint(std::string_view& in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(in.front());
+        in.remove_prefix(1);
+        value |= uint64_t{byte & 0x7Fu} << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+} // anonymous namespace
+
+QuantileSketch::QuantileSketch(double compression)
+    : compression_(std::clamp(std::isfinite(compression) ? compression : DEFAULT_COMPRESSION,
+                              MIN_COMPRESSION, MAX_COMPRESSION)) {}
+
+void QuantileSketch::add(double value, uint64_t weight) {
+    if (weight == 0) return;
+    
+    if (count_ == 0) {
+        min_ = max_ = value;
+    } else {
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+    count_ += weight;
     
-    double sum_diff = 0.0;
-    for (size_t i = 1; i < values_.size(); ++i) {
-        sum_diff += std::abs(values_[i] - values_[i-1]);
+    buffer_.push_back({value, weight});
+    if (buffer_.size() >= static_cast<size_t>(compression_ * 5)) {
+        compress();
     }
-    return sum_diff / (values_.size() - 1);
+}
+
+void QuantileSketch::add(const Histogram& histogram) {
+    if (histogram.count() == 0) return;
+    
+    // Buckets arrive sorted, so compress once at the end: compressing a
+    // sorted prefix would build tail-sized centroids that can't be split
+    const auto& layout = histogram.layout();
+    for (size_t i = 0; i < layout.bucket_count(); ++i) {
+        uint64_t n = histogram.bucket(i);
+        if (n == 0) continue;
+        double mid = (layout.lowest_in(i) + layout.highest_in(i)) / 2.0 / 1e6;
+        buffer_.push_back({std::clamp(mid, histogram.min(), histogram.max()), n});
+    }
+    absorb(histogram.count(), histogram.min(), histogram.max());
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+    if (other.count_ == 0) return;
+    
+    const auto& cs = other.centroids();
+    buffer_.insert(buffer_.end(), cs.begin(), cs.end());
+    absorb(other.count_, other.min_, other.max_);
+}
+
+void QuantileSketch::absorb(uint64_t count, double min, double max) {
+    if (count_ == 0) {
+        min_ = min;
+        max_ = max;
+    } else {
+        min_ = std::min(min_, min);
+        max_ = std::max(max_, max);
+    }
+    count_ += count;
+    compress();
+}
+
+void QuantileSketch::compress() const {
+    if (buffer_.empty()) return;
+    
+    buffer_.insert(buffer_.end(), centroids_.begin(), centroids_.end());
+    std::ranges::sort(buffer_, {}, &Centroid::mean);
+    
+    double total = static_cast<double>(count_);
+    double norm = scale_norm(compression_, total);
+    std::vector<Centroid> merged;
+    merged.reserve(static_cast<size_t>(compression_) + 1);
+    
+    Centroid current = buffer_.front();
+    double weight_before = 0.0;
+    double limit = total * scale_q(scale_k(0.0, compression_, norm) + 1.0, compression_, norm);
+    
+    for (size_t i = 1; i < buffer_.size(); ++i) {
+        const auto& next = buffer_[i];
+        if (weight_before + current.weight + next.weight <= limit) {
+            double w = static_cast<double>(current.weight + next.weight);
+            current.mean += (next.mean - current.mean) * next.weight / w;
+            current.weight += next.weight;
+        } else {
+            weight_before += current.weight;
+            merged.push_back(current);
+            limit = total * scale_q(
+                scale_k(weight_before / total, compression_, norm) + 1.0, compression_, norm);
+            current = next;
+        }
+    }
+    merged.push_back(current);
+    
+    centroids_ = std::move(merged);
+    buffer_.clear();
+}
+
+const std::vector<QuantileSketch::Centroid>& QuantileSketch::centroids() const {
+    compress();
+    return centroids_;
+}
+
+double QuantileSketch::quantile(double q) const {
+    if (count_ == 0) return 0.0;
+    if (q <= 0.0) return min_;
+    if (q >= 1.0) return max_;
+    
+    const auto& cs = centroids();
+    if (cs.size() == 1) return cs.front().mean;
+    
+    // Interpolate between centroid centres; the ends interpolate towards
+    // the exact min and max
+    double index = q * count_;
+    double first_half = cs.front().weight / 2.0;
+    if (index < first_half) {
+        return min_ + (cs.front().mean - min_) * (index / first_half);
+    }
+    
+    double cumulative = first_half;
+    for (size_t i = 0; i + 1 < cs.size(); ++i) {
+        double gap = (cs[i].weight + cs[i + 1].weight) / 2.0;
+        if (index < cumulative + gap) {
+            double t = (index - cumulative) / gap;
+            return cs[i].mean + (cs[i + 1].mean - cs[i].mean) * t;
+        }
+        cumulative += gap;
+    }
+    
+    double last_half = cs.back().weight / 2.0;
+    double t = std::min(1.0, (index - cumulative) / last_half);
+    return cs.back().mean + (max_ - cs.back().mean) * t;
+}
+
+std::string QuantileSketch::serialize() const {
+    const auto& cs = centroids();
+    
+    std::string out;
+    out.reserve(40 + cs.size() * 10);
+    put_bytes(out, SKETCH_MAGIC, sizeof(SKETCH_MAGIC));
+    out.push_back(static_cast<char>(SKETCH_VERSION));
+    put_double(out, compression_);
+    put_varint(out, count_);
+    put_double(out, min_);
+    put_double(out, max_);
+    put_varint(out, cs.size());
+    for (const auto& c : cs) {
+        put_double(out, c.mean);
+        put_varint(out, c.weight);
+    }
+    return out;
+}
+
+Result<QuantileSketch> QuantileSketch::deserialize(std::string_view data) {
+    if (data.size() < 5 || std::memcmp(data.data(), SKETCH_MAGIC, 4) != 0) {
+        return Result<QuantileSketch>("Not a quantile sketch");
+    }
+    if (static_cast<uint8_t>(data[4]) != SKETCH_VERSION) {
+        return Result<QuantileSketch>(std::format("Unsupported sketch version {}", 
+            static_cast<int>(data[4])));
+    }
+    data.remove_prefix(5);
+    
+    double compression, min, max;
+    uint64_t count, size;
+    if (!get_double(data, compression) || !get_varint(data, count) ||
+        !get_double(data, min) || !get_double(data, max) || !get_varint(data, size)) {
+        return Result<QuantileSketch>("Truncated sketch header");
+    }
+    
+    // The blob may come from anywhere; nothing out of range gets as far
+    // as a sketch
+    if (!std::isfinite(compression) || compression < MIN_COMPRESSION || compression > MAX_COMPRESSION) {
+        return Result<QuantileSketch>("Sketch compression out of range");
+    }
+    if (!std::isfinite(min) || !std::isfinite(max) || min > max) {
+        return Result<QuantileSketch>("Sketch bounds are invalid");
+    }
+    
+    QuantileSketch sketch(compression);
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < size; ++i) {
+        Centroid c;
+        if (!get_double(data, c.mean) || !get_varint(data, c.weight)) {
+            return Result<QuantileSketch>("Truncated sketch centroids");
+        }
+        if (!std::isfinite(c.mean)) {
+            return Result<QuantileSketch>("Sketch centroid is not a number");
+        }
+        if (c.weight == 0 || c.weight > UINT64_MAX - total) {
+            return Result<QuantileSketch>("Sketch centroid weight is invalid");
+        }
+        sketch.centroids_.push_back(c);
+        total += c.weight;
+    }
+    if (total != count) {
+        return Result<QuantileSketch>("Sketch weights do not match count");
+    }
+    
+    sketch.count_ = count;
+    sketch.min_ = min;
+    sketch.max_ = max;
+    return sketch;
+}
+
+std::string QuantileSketch::to_json() const {
+    const auto& cs = centroids();
+    
+    std::string means;
+    std::string weights;
+    for (size_t i = 0; i < cs.size(); ++i) {
+        if (i > 0) {
+            means += ",";
+            weights += ",";
+        }
+        means += std::format("{:.6g}", cs[i].mean);
+        weights += std::format("{}", cs[i].weight);
+    }
+    
+    return std::format(R"({{"type":"tdigest","compression":{:.0f},"count":{},"min":{:.6g},"max":{:.6g},"means":[{}],"weights":[{}]}})",
+        compression_, count_, min(), max(), means, weights);
+}
+
+// LatencyRecorder implementation
+LatencyRecorder::LatencyRecorder(int significant_digits)
+    : layout_(significant_digits),
+      counts_(std::make_unique<std::atomic<uint64_t>[]>(layout_.bucket_count())) {}
+
+void LatencyRecorder::record(double ms) {
+    record_nanos(Histogram::to_nanos(ms));
+}
+
+void LatencyRecorder::record_nanos(uint64_t nanos) {
+    // Relaxed RMWs on lines only this thread writes stay uncontended;
+    // the reader synchronises by exchanging the counters out
+    counts_[layout_.index_of(nanos)].fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(nanos, std::memory_order_relaxed);
+    
+    uint64_t current = min_ns_.load(std::memory_order_relaxed);
+    while (nanos < current &&
+           !min_ns_.compare_exchange_weak(current, nanos, std::memory_order_relaxed)) {}
+    
+    current = max_ns_.load(std::memory_order_relaxed);
+    while (nanos > current &&
+           !max_ns_.compare_exchange_weak(current, nanos, std::memory_order_relaxed)) {}
+}
+
+void LatencyRecorder::drain_into(Histogram& out) {
+    if (!(out.layout_ == layout_)) {
+        throw std::invalid_argument("Histogram precision does not match recorder");
+    }
+    
+    // Values above the top bucket are counted in it
+    size_t top = layout_.bucket_count() - 1;
+    auto highest = [&](size_t index) {
+        return index == top ? UINT64_MAX : layout_.highest_in(index);
+    };
+    
+    // The range of sums the drained buckets allow, and the first and last
+    // bucket drained
+    uint64_t low_sum = 0;
+    uint64_t high_sum = 0;
+    size_t first = top + 1;
+    size_t last = 0;
+    for (size_t i = 0; i < layout_.bucket_count(); ++i) {
+        if (counts_[i].load(std::memory_order_relaxed) == 0) continue;
+        uint64_t count = counts_[i].exchange(0, std::memory_order_acq_rel);
+        out.add_bucket(i, count);
+        
+        first = std::min(first, i);
+        last = i;
+        low_sum += count * layout_.lowest_in(i);
+        high_sum = i == top ? UINT64_MAX : high_sum + count * layout_.highest_in(i);
+    }
+    uint64_t sum = sum_ns_.exchange(0, std::memory_order_acq_rel);
+    uint64_t min = min_ns_.exchange(UINT64_MAX, std::memory_order_acq_rel);
+    uint64_t max = max_ns_.exchange(0, std::memory_order_acq_rel);
+    if (first > last) return;
+    
+    // A sample recorded during the drain can have its bucket counted now
+    // and its sum, min and max next time, or the other way round. The
+    // exact figures stand wherever the drained buckets agree with them and
+    // are clamped to those buckets otherwise, so each drain is consistent
+    // in itself and the mean stays within its buckets. Clamped into one
+    // bucket from outside it, min and max cross over and span it instead.
+    min = std::clamp(min, layout_.lowest_in(first), highest(first));
+    max = std::clamp(max, layout_.lowest_in(last), highest(last));
+    if (min > max) std::swap(min, max);
+    
+    out.sum_ns_ += std::clamp(sum, low_sum, high_sum);
+    out.min_ns_ = std::min(out.min_ns_, min);
+    out.max_ns_ = std::max(out.max_ns_, max);
 }
 
 } // namespace netprobe
@@ -5,16 +5,98 @@
 #include <algorithm>
 #include <cmath>
 #include <numeric>
+#include <atomic>
+#include <memory>
+#include <optional>
 
 namespace netprobe {
 
-// Running statistics calculator
+// Bucket layout of the log-linear histograms, parameterised HDR-style by
+// the number of significant decimal digits to preserve. Values are integer
+// nanoseconds: linear buckets below 2^sub_bits, then a fixed number of
+// buckets per power of two up to ~73 minutes. Index and bounds are O(1).
+class BucketLayout {
+public:
+    static constexpr int MAX_VALUE_BITS = 42;
+    static constexpr int DEFAULT_DIGITS = 2;
+    
+    explicit BucketLayout(int significant_digits = DEFAULT_DIGITS);
+    
+    int significant_digits() const { return digits_; }
+    size_t bucket_count() const { return bucket_count_; }
+    
+    size_t index_of(uint64_t nanos) const;
+    uint64_t lowest_in(size_t index) const;
+    uint64_t highest_in(size_t index) const;
+    
+    bool operator==(const BucketLayout& other) const { return digits_ == other.digits_; }
+
+private:
+    int digits_;
+    int sub_bits_;
+    size_t sub_count_;
+    size_t sub_half_;
+    size_t bucket_count_;
+};
+
+// Fixed-memory log-linear (HDR-style) latency histogram, values in
+// milliseconds. Memory depends only on the precision, not on the number
+// of samples: ~37KB at 2 significant digits, ~300KB at 3.
+class Histogram {
+public:
+    explicit Histogram(int significant_digits = BucketLayout::DEFAULT_DIGITS);
+    
+    void add(double value);
+    void add_nanos(uint64_t nanos);
+    void add_bucket(size_t index, uint64_t count);
+    void merge(const Histogram& other);
+    void reset();
+    
+    const BucketLayout& layout() const { return layout_; }
+    size_t count() const { return count_; }
+    double min() const;
+    double max() const;
+    double mean() const;
+    double stddev() const;
+    double percentile(double p) const; // p in [0, 100]
+    uint64_t bucket(size_t index) const { return counts_[index]; }
+    
+    static uint64_t to_nanos(double ms);
+
+private:
+    friend class LatencyRecorder;
+    
+    BucketLayout layout_;
+    std::vector<uint64_t> counts_;
+    size_t count_ = 0;
+    uint64_t sum_ns_ = 0;
+    uint64_t min_ns_ = UINT64_MAX;
+    uint64_t max_ns_ = 0;
+};
+
+// Running statistics calculator.
+//
+// The EXACT backend keeps every sample and answers percentiles exactly
+// (sorting lazily, once per batch of additions). The HISTOGRAM backend
+// uses fixed memory and O(1) add / O(buckets) percentile at the chosen
+// precision, for long or high-rate runs. Count, mean, stddev, min, max
+// and jitter are tracked incrementally and exact in both.
 class Statistics {
 public:
+    enum class Backend {
+        EXACT,
+        HISTOGRAM
+    };
+    
+    explicit Statistics(Backend backend = Backend::EXACT,
+                        int significant_digits = BucketLayout::DEFAULT_DIGITS);
+    
     void add(double value);
     void reset();
+    void merge(const Statistics& other);
     
-    size_t count() const { return values_.size(); }
+    Backend backend() const { return backend_; }
+    size_t count() const { return count_; }
     double min() const;
     double max() const;
     double mean() const;
@@ -23,12 +105,134 @@ public:
     double percentile(double p) const; // p in [0, 100]
     double jitter() const;
     
+    // Raw samples (EXACT backend only; order unspecified)
     const std::vector<double>& values() const { return values_; }
 
 private:
-    std::vector<double> values_;
+    void switch_to_histogram(int significant_digits);
+    
+    Backend backend_;
+    mutable std::vector<double> values_;
+    mutable bool sorted_ = true;
+    std::optional<Histogram> histogram_;
+    
+    size_t count_ = 0;
     double sum_ = 0.0;
     double sum_sq_ = 0.0;
+    double min_ = 0.0;
+    double max_ = 0.0;
+    double last_ = 0.0;
+    double jitter_sum_ = 0.0;
+};
+
+// Statistics over the last `capacity` probes of a series, lost ones
+// included, for views that run indefinitely. Memory is fixed: the samples
+// sit in a ring, and count, loss, mean and stddev move incrementally as
+// they enter and leave it. Best and worst take a scan of the ring, as they
+// are read once per refresh rather than once per sample.
+class RollingWindow {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 100;
+    
+    explicit RollingWindow(size_t capacity = DEFAULT_CAPACITY);
+    
+    void add(double value);
+    void add_loss();
+    
+    size_t size() const { return size_; }          // Probes in the window
+    size_t received() const { return received_; }  // Of those, answered
+    double loss() const;                            // Percent
+    double last() const { return last_; }           // Latest answer, NaN if none yet
+    double min() const;
+    double max() const;
+    double mean() const;
+    double stddev() const;
+
+private:
+    void push(double value);
+    
+    std::vector<double> samples_;   // NaN marks a loss
+    size_t next_ = 0;
+    size_t size_ = 0;
+    size_t received_ = 0;
+    double sum_ = 0.0;
+    double sum_sq_ = 0.0;
+    double last_;
+};
+
+// Mergeable streaming quantile sketch (merging t-digest). Keeps at most
+// ~compression centroids, with finer resolution near the tails, so p99 and
+// p99.9 stay accurate while the whole distribution fits in a few KB.
+// Sketches from many runs or hosts can be merged into one, and shipped
+// either as a compact binary blob or as JSON.
+class QuantileSketch {
+public:
+    static constexpr double DEFAULT_COMPRESSION = 200.0;
+    static constexpr double MIN_COMPRESSION = 10.0;
+    static constexpr double MAX_COMPRESSION = 100000.0;
+    
+    struct Centroid {
+        double mean;
+        uint64_t weight;
+    };
+    
+    explicit QuantileSketch(double compression = DEFAULT_COMPRESSION);
+    
+    void add(double value, uint64_t weight = 1);
+    void add(const Histogram& histogram);
+    void merge(const QuantileSketch& other);
+    
+    uint64_t count() const { return count_; }
+    double min() const { return count_ ? min_ : 0.0; }
+    double max() const { return count_ ? max_ : 0.0; }
+    double compression() const { return compression_; }
+    double quantile(double q) const; // q in [0, 1]
+    double percentile(double p) const { return quantile(p / 100.0); }
+    
+    const std::vector<Centroid>& centroids() const;
+    
+    // Little-endian binary: magic, version, compression, count, min, max,
+    // then per centroid a double mean and a varint weight
+    std::string serialize() const;
+    static Result<QuantileSketch> deserialize(std::string_view data);
+    
+    // {"type":"tdigest","compression":..,"count":..,"min":..,"max":..,
+    //  "means":[..],"weights":[..]}
+    std::string to_json() const;
+
+private:
+    void absorb(uint64_t count, double min, double max);
+    void compress() const;
+    
+    double compression_;
+    uint64_t count_ = 0;
+    double min_ = 0.0;
+    double max_ = 0.0;
+    mutable std::vector<Centroid> centroids_;
+    mutable std::vector<Centroid> buffer_;
+};
+
+// Per-thread latency recorder. The owning thread records wait-free into
+// pre-allocated atomic buckets (no allocation, no locks on the hot path);
+// any other thread may drain the samples recorded so far into a Histogram
+// of the same precision, e.g. once per reporting interval, while
+// recording continues.
+class LatencyRecorder {
+public:
+    explicit LatencyRecorder(int significant_digits = BucketLayout::DEFAULT_DIGITS);
+    
+    void record(double ms);
+    void record_nanos(uint64_t nanos);
+    
+    // Move everything recorded since the previous drain into `out`
+    void drain_into(Histogram& out);
+
+private:
+    BucketLayout layout_;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts_;
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> min_ns_{UINT64_MAX};
+    std::atomic<uint64_t> max_ns_{0};
 };
 
 } // namespace netprobe
@@ -0,0 +1,143 @@
+#include "targets.h"
+#include "socket.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <fstream>
+
+namespace netprobe {
+
+namespace {
+
+std::string_view trim(std::string_view text) {
+    auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) return {};
+    auto last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+} // anonymous namespace
+
+// TargetSet implementation
+Result<void> TargetSet::add(std::string_view spec) {
+    spec = trim(spec);
+    if (spec.empty()) {
+        return Result<void>("Empty target");
+    }
+    
+    auto slash = spec.find('/');
+    if (slash == std::string_view::npos) {
+        auto addr = Socket::resolve(spec, 0);
+        if (!addr) {
+            return Result<void>(std::format("{}: {}", spec, addr.error));
+        }
+        add_range(ntohl(addr->sin_addr.s_addr), 1);
+        return Result<void>();
+    }
+    
+    // CIDR block: the address part must be numeric
+    std::string network(spec.substr(0, slash));
+    auto prefix_str = spec.substr(slash + 1);
+    in_addr addr{};
+    int prefix = -1;
+    auto [ptr, ec] = std::from_chars(prefix_str.data(), prefix_str.data() + prefix_str.size(), prefix);
+    
+    if (inet_pton(AF_INET, network.c_str(), &addr) != 1 || ec != std::errc() ||
+        ptr != prefix_str.data() + prefix_str.size() || prefix < 0 || prefix > 32) {
+        return Result<void>(std::format("Invalid CIDR block: {}", spec));
+    }
+    
+    uint64_t count = uint64_t{1} << (32 - prefix);
+    uint32_t first = ntohl(addr.s_addr) & static_cast<uint32_t>(~(count - 1));
+    add_range(first, count);
+    return Result<void>();
+}
+
+Result<void> TargetSet::add_file(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return Result<void>(std::format("Cannot open {}", path));
+    }
+    
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        std::string_view spec = line;
+        spec = trim(spec.substr(0, spec.find('#')));
+        if (spec.empty()) continue;
+        
+        auto res = add(spec);
+        if (!res) {
+            return Result<void>(std::format("{}:{}: {}", path, line_number, res.error));
+        }
+    }
+    return Result<void>();
+}
+
+void TargetSet::add_range(uint32_t first, uint64_t count) {
+    ranges_.push_back({size_, first, count});
+    size_ += count;
+}
+
+in_addr_t TargetSet::at(uint64_t index) const {
+    auto it = std::upper_bound(ranges_.begin(), ranges_.end(), index,
+        [](uint64_t i, const Range& range) { return i < range.offset; });
+    const Range& range = *std::prev(it);
+    return htonl(static_cast<uint32_t>(range.first + (index - range.offset)));
+}
+
+uint64_t TargetSet::digest() const {
+    uint64_t hash = 0;
+    for (const auto& range : ranges_) {
+        hash = mix(hash ^ range.first);
+        hash = mix(hash ^ range.count);
+    }
+    return hash;
+}
+
+// Permutation implementation
+Permutation::Permutation(uint64_t size, uint64_t seed) : size_(size) {
+    // Even bit width, so the two Feistel halves are the same size
+    int bits = 2;
+    while (bits < 64 && (uint64_t{1} << bits) < size) bits += 2;
+    half_bits_ = bits / 2;
+    half_mask_ = (uint64_t{1} << half_bits_) - 1;
+    
+    for (int i = 0; i < ROUNDS; ++i) {
+        keys_[i] = mix(seed + 0x9E3779B97F4A7C15ull * (i + 1));
+    }
+}
+
+uint64_t Permutation::round(uint64_t half, int index) const {
+    return mix(half ^ keys_[index]) & half_mask_;
+}
+
+uint64_t Permutation::encrypt(uint64_t value) const {
+    uint64_t left = value >> half_bits_;
+    uint64_t right = value & half_mask_;
+    for (int i = 0; i < ROUNDS; ++i) {
+        uint64_t next = left ^ round(right, i);
+        left = right;
+        right = next;
+    }
+    return (left << half_bits_) | right;
+}
+
+uint64_t Permutation::map(uint64_t index) const {
+    uint64_t value = encrypt(index);
+    while (value >= size_) value = encrypt(value);
+    return value;
+}
+
+} // namespace netprobe
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "common.h"
+#include <netinet/in.h>
+#include <vector>
+
+namespace netprobe {
+
+// A set of IPv4 targets built from addresses, hostnames and CIDR blocks.
+//
+// Blocks are kept as ranges and expanded on demand, so a /8 costs the same
+// as a single host; at() maps a target index back to its address.
+class TargetSet {
+public:
+    // "10.0.0.5", "example.com" or "10.0.0.0/16"
+    Result<void> add(std::string_view spec);
+    
+    // One spec per line; blank lines and '#' comments are skipped
+    Result<void> add_file(const std::string& path);
+    
+    uint64_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    
+    // Address of target `index` < size(), in network byte order
+    in_addr_t at(uint64_t index) const;
+    
+    // Changes with the targets and their order, so a saved scan can tell
+    // whether it is resumed against the same set
+    uint64_t digest() const;
+
+private:
+    struct Range {
+        uint64_t offset;        // Index of the range's first target
+        uint32_t first;         // Host byte order
+        uint64_t count;
+    };
+    
+    void add_range(uint32_t first, uint64_t count);
+    
+    std::vector<Range> ranges_;
+    uint64_t size_ = 0;
+};
+
+// Pseudo-random bijection on [0, size).
+//
+// Lets a scan visit a large index space in scattered order without storing
+// it: a small Feistel network permutes the next power of four at or above
+// `size`, and values that land outside the domain are re-encrypted until
+// they fall inside (cycle walking), which takes under four rounds on
+// average.
+class Permutation {
+public:
+    Permutation(uint64_t size, uint64_t seed);
+    
+    uint64_t size() const { return size_; }
+    uint64_t map(uint64_t index) const;
+
+private:
+    static constexpr int ROUNDS = 4;
+    
+    uint64_t encrypt(uint64_t value) const;
+    uint64_t round(uint64_t half, int index) const;
+    
+    uint64_t size_;
+    int half_bits_;
+    uint64_t half_mask_;
+    uint64_t keys_[ROUNDS];
+};
+
+} // namespace netprobe
@@ -0,0 +1,97 @@
+#include "timestamps.h"
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <cstring>
+
+namespace netprobe {
+
+namespace {
+
+constexpr unsigned SOFTWARE_FLAGS =
+    SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+constexpr unsigned HARDWARE_FLAGS =
+    SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+
+// Number the sends, and return only the stamp, not a copy of the packet
+constexpr unsigned OPTION_FLAGS = SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+int64_t nanos(const timespec& ts) {
+    return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+} // anonymous namespace
+
+const char* timestamp_source_name(TimestampSource source) {
+    switch (source) {
+        case TimestampSource::HARDWARE: return "hardware";
+        case TimestampSource::SOFTWARE: return "kernel";
+        case TimestampSource::USERSPACE: break;
+    }
+    return "userspace";
+}
+
+bool enable_timestamps(int fd) {
+    // Hardware stamps are asked for first; kernels that refuse the
+    // combination still take software ones
+    for (unsigned flags : {SOFTWARE_FLAGS | HARDWARE_FLAGS | OPTION_FLAGS, SOFTWARE_FLAGS | OPTION_FLAGS}) {
+        if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+KernelTimestamp message_timestamp(const msghdr& msg) {
+    KernelTimestamp stamp;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(const_cast<msghdr*>(&msg)); cmsg;
+         cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&msg), cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            scm_timestamping ts{};
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            stamp.software_ns = nanos(ts.ts[0]);
+            stamp.hardware_ns = nanos(ts.ts[2]);
+        }
+    }
+    return stamp;
+}
+
+std::optional<TxTimestamp> read_tx_timestamp(int fd) {
+    alignas(cmsghdr) char control[TIMESTAMP_CONTROL_SIZE];
+    
+    while (true) {
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return std::nullopt;
+        }
+        
+        // Skip anything on the queue that is not a send stamp, such as
+        // an ICMP error
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) continue;
+            
+            sock_extended_err err{};
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING && err.ee_info == SCM_TSTAMP_SND) {
+                return TxTimestamp{err.ee_data, message_timestamp(msg)};
+            }
+        }
+    }
+}
+
+std::optional<KernelRtt> kernel_rtt(const KernelTimestamp& sent, const KernelTimestamp& received) {
+    auto rtt = [](int64_t from, int64_t to) { return static_cast<double>(to - from) / 1e6; };
+    
+    if (sent.hardware_ns && received.hardware_ns && received.hardware_ns >= sent.hardware_ns) {
+        return KernelRtt{rtt(sent.hardware_ns, received.hardware_ns), TimestampSource::HARDWARE};
+    }
+    if (sent.software_ns && received.software_ns && received.software_ns >= sent.software_ns) {
+        return KernelRtt{rtt(sent.software_ns, received.software_ns), TimestampSource::SOFTWARE};
+    }
+    return std::nullopt;
+}
+
+} // namespace netprobe
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common.h"
+#include <sys/socket.h>
+#include <optional>
+
+namespace netprobe {
+
+// Where a round-trip time was measured, most precise first
+enum class TimestampSource {
+    HARDWARE,       // By the NIC, as the packets crossed the wire
+    SOFTWARE,       // By the kernel, at the driver boundary
+    USERSPACE       // Around the send and receive syscalls
+};
+
+const char* timestamp_source_name(TimestampSource source);
+
+// When the kernel saw a packet. Software stamps are on CLOCK_REALTIME and
+// hardware ones on the NIC's own clock, so only stamps of the same kind
+// can be subtracted. Zero: not taken.
+struct KernelTimestamp {
+    int64_t software_ns = 0;
+    int64_t hardware_ns = 0;
+};
+
+// A send stamp from the error queue. `key` counts the socket's sends,
+// from 0 for the first one after enable_timestamps().
+struct TxTimestamp {
+    uint32_t key;
+    KernelTimestamp stamp;
+};
+
+// Ask the kernel to stamp every packet `fd` sends and receives: in
+// software always, and in hardware too where the NIC has been configured
+// for it (by a PTP daemon, say; netprobe does not change device settings).
+// False if the kernel supports neither.
+bool enable_timestamps(int fd);
+
+// Control buffer big enough for a received message's stamp
+constexpr size_t TIMESTAMP_CONTROL_SIZE = 256;
+
+// The stamp among the control messages of a recvmsg() result, from the
+// receive queue or the error queue
+KernelTimestamp message_timestamp(const msghdr& msg);
+
+// Take one send stamp off `fd`'s error queue without blocking; nullopt
+// once none are left. Hardware and software stamps of one packet come
+// back as separate entries with the same key.
+std::optional<TxTimestamp> read_tx_timestamp(int fd);
+
+// Round trip in milliseconds between the stamps of a request and its
+// reply, from the most precise source both have
+struct KernelRtt {
+    double ms;
+    TimestampSource source;
+};
+
+std::optional<KernelRtt> kernel_rtt(const KernelTimestamp& sent, const KernelTimestamp& received);
+
+} // namespace netprobe